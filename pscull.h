@@ -23,24 +23,23 @@
 #define PSCULL_NR_DEVS 4
 #define PSCULL_BUFFER_SIZE 8000
 
-// pscull device number
-dev_t dev_no;
+// where the rings are allocated
+#define PSCULL_NUMA_LOCAL 0      // node running insmod
+#define PSCULL_NUMA_BIND 1       // all on pscull_numa_node
+#define PSCULL_NUMA_INTERLEAVE 2 // device i on the i-th online node
 
-// pscull's file operation structure forward declaration 
-struct file_operations pscull_fops;
 struct pscull_dev;
 
-// pscull_fops methods
-static void pscull_cleanup_module(void);
-static void pscull_exit(void);
-static int pscull_fasync(int fd, struct file *filp, int mode);
-int pscull_open(struct inode *inode, struct file *filp);
-static unsigned int pscull_poll(struct file *filp, poll_table *wait);
-ssize_t pscull_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
-int pscull_release(struct inode *inode, struct file *filp);
-static void pscull_setup_cdev(struct pscull_dev *dev, int index);
-ssize_t pscull_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos);
-static int spacefree(struct pscull_dev *dev);
+/*
+ * Ring buffer arithmetic (pscull_ring.c), kept apart from the file
+ * operations so it also builds in user space. Callers hold dev->sem.
+ */
+void pscull_ring_init(struct pscull_dev *dev, char *buffer, int buffersize);
+int pscull_spacefree(struct pscull_dev *dev);
+size_t pscull_read_chunk(struct pscull_dev *dev, size_t count);
+size_t pscull_write_chunk(struct pscull_dev *dev, size_t count);
+void pscull_read_done(struct pscull_dev *dev, size_t count);
+void pscull_write_done(struct pscull_dev *dev, size_t count);
 
 struct pscull_dev {
 	wait_queue_head_t inq, outq;
@@ -48,14 +47,14 @@ struct pscull_dev {
 	int buffersize;
 	char *rp, *wp;
 	int nreaders, nwriters;
+	int node;		// node the ring ended up on
 	struct fasync_struct *async_queue;
 	struct semaphore sem;
 	struct cdev cdev;
 };
 
-//struct pscull_dev dev;
-struct pscull_dev *pscull_devs;
-
 extern int pscull_major;
 extern int pscull_minor;
 extern int pscull_nr_devs;
+extern int pscull_numa_policy;
+extern int pscull_numa_node;
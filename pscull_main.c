@@ -0,0 +1,299 @@
+#include <asm/uaccess.h>
+#include <linux/cdev.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/ioctl.h>
+#include <linux/proc_fs.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include "pscull.h"
+
+MODULE_LICENSE("Dual BSD/GPL");
+
+// pscull device number
+dev_t dev_no;
+
+// pscull's file operation structure forward declaration 
+struct file_operations pscull_fops;
+
+// pscull_fops methods
+static void pscull_cleanup_module(void);
+static void pscull_exit(void);
+static int pscull_fasync(int fd, struct file *filp, int mode);
+int pscull_open(struct inode *inode, struct file *filp);
+static __poll_t pscull_poll(struct file *filp, poll_table *wait);
+ssize_t pscull_read_iter(struct kiocb *iocb, struct iov_iter *to);
+int pscull_release(struct inode *inode, struct file *filp);
+static void pscull_setup_cdev(struct pscull_dev *dev, int index);
+ssize_t pscull_write_iter(struct kiocb *iocb, struct iov_iter *from);
+static int pscull_dev_node(int index);
+
+//struct pscull_dev dev;
+struct pscull_dev *pscull_devs;
+
+int pscull_major = PSCULL_MAJOR;
+int pscull_minor = PSCULL_MINOR;
+int pscull_nr_devs = PSCULL_NR_DEVS;
+int pscull_buffer_size = PSCULL_BUFFER_SIZE; 
+int pscull_numa_policy = PSCULL_NUMA_LOCAL;
+int pscull_numa_node = 0;
+
+module_param(pscull_numa_policy, int, S_IRUGO);
+module_param(pscull_numa_node, int, S_IRUGO);
+
+struct file_operations pscull_fops = {
+	.owner = THIS_MODULE,
+	.fasync = pscull_fasync,
+	.read_iter = pscull_read_iter,
+	.write_iter = pscull_write_iter,
+	.poll = pscull_poll,
+	.llseek = no_llseek,
+	.open = pscull_open,
+	.release = pscull_release,
+};
+
+// node the ring of device index is allocated on, see PSCULL_NUMA_*
+static int pscull_dev_node(int index)
+{
+	int node = first_online_node;
+
+	switch (pscull_numa_policy) {
+	case PSCULL_NUMA_BIND:
+		return pscull_numa_node;
+	case PSCULL_NUMA_INTERLEAVE:
+		for (index %= num_online_nodes(); index; index--)
+			node = next_online_node(node);
+		return node;
+	}
+	return NUMA_NO_NODE;
+}
+
+static int pscull_init(void)
+{
+	int i, node, rings, result;
+    
+	result = alloc_chrdev_region(&dev_no, pscull_minor, pscull_nr_devs, "pscull");
+	if (result < 0) {
+		printk(KERN_WARNING "pscull: can't get major %d\n",pscull_major);
+		return result;
+    }
+	pscull_major = MAJOR(dev_no);
+	pscull_devs = kmalloc(pscull_nr_devs * sizeof(struct pscull_dev), GFP_KERNEL);
+	if (!pscull_devs) {
+		result = -ENOMEM;
+		goto fail;
+	}
+	memset(pscull_devs, 0, pscull_nr_devs * sizeof(struct pscull_dev));
+	if (pscull_numa_policy == PSCULL_NUMA_BIND &&
+	    (pscull_numa_node < 0 || pscull_numa_node >= nr_node_ids ||
+	     !node_online(pscull_numa_node))) {
+		printk(KERN_WARNING "pscull: node %d is not online\n", pscull_numa_node);
+		result = -EINVAL;
+		goto fail;
+	}
+	for (i = 0; i < pscull_nr_devs; i++) {
+		pscull_devs[i].buffersize = pscull_buffer_size;
+		pscull_devs[i].buffer = kmalloc_node(pscull_buffer_size * sizeof(char), GFP_KERNEL,
+						     pscull_dev_node(i));
+		if (!pscull_devs[i].buffer) {
+			result = -ENOMEM;
+			goto fail;
+		}
+		pscull_devs[i].node = page_to_nid(virt_to_page(pscull_devs[i].buffer));
+		pscull_ring_init(&pscull_devs[i], pscull_devs[i].buffer, pscull_buffer_size);
+		init_waitqueue_head(&pscull_devs[i].inq);
+		init_waitqueue_head(&pscull_devs[i].outq);
+		sema_init(&pscull_devs[i].sem, 1);
+	}
+	// all rings are there, open() can't find a device without one
+	for (i = 0; i < pscull_nr_devs; i++)
+		pscull_setup_cdev(&pscull_devs[i], i);
+
+	// report how the rings got spread over the nodes
+	for_each_online_node(node) {
+		rings = 0;
+		for (i = 0; i < pscull_nr_devs; i++)
+			if (pscull_devs[i].node == node)
+				rings++;
+		printk(KERN_INFO "pscull: node %d: %d rings\n", node, rings);
+	}
+	printk(KERN_INFO "init_module() called\n");
+	return 0;
+	
+	fail:
+		pscull_cleanup_module();
+		return result;
+}
+
+static void pscull_cleanup_module(void)
+{
+	int i;
+	printk(KERN_INFO "cleanup_module() called\n");
+	for (i = 0; pscull_devs && i < pscull_nr_devs; i++) {
+		// set by pscull_setup_cdev
+		if (pscull_devs[i].cdev.ops)
+			cdev_del(&pscull_devs[i].cdev);
+		kfree(pscull_devs[i].buffer);
+		pscull_devs[i].end = NULL;
+		pscull_devs[i].rp = NULL;
+		pscull_devs[i].wp = NULL;
+	}
+	kfree(pscull_devs);
+	pscull_devs = NULL;
+	unregister_chrdev_region(dev_no, pscull_nr_devs);
+}
+
+static void pscull_exit(void)
+{
+    	pscull_cleanup_module();
+	printk(KERN_INFO "exit_module() called\n");
+}
+
+static int pscull_fasync(int fd, struct file *filp, int mode)
+{
+	printk(KERN_INFO "pscull_fasync called\n");
+	struct pscull_dev *dev = filp->private_data;
+	return fasync_helper(fd, filp, mode, &dev->async_queue);
+}
+
+int pscull_open(struct inode *inode, struct file *filp)
+{
+    	struct pscull_dev *dev; // device information
+
+    	dev = container_of(inode->i_cdev, struct pscull_dev, cdev);
+    	filp->private_data = dev; // for other methods
+	// IOCB_NOWAIT requests get -EAGAIN instead of sleeping, see pscull_nowait
+	filp->f_mode |= FMODE_NOWAIT;
+
+    	return 0; //success
+}
+
+/*
+ * No semaphore here: io_uring arms its poll handler from paths that must
+ * not sleep. The wait queues are registered before rp/wp are looked at, so
+ * a racing reader or writer still wakes us up.
+ */
+static __poll_t pscull_poll(struct file *filp, poll_table *wait)
+{
+	struct pscull_dev *dev = filp->private_data;
+	__poll_t mask = 0;
+	poll_wait(filp, &dev->inq, wait);
+	poll_wait(filp, &dev->outq, wait);
+	if (READ_ONCE(dev->rp) != READ_ONCE(dev->wp))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (pscull_spacefree(dev))
+		mask |= EPOLLOUT | EPOLLWRNORM;
+	return mask;
+}
+
+/*
+ * Non-blocking callers (O_NONBLOCK or IOCB_NOWAIT) only trylock the
+ * semaphore and get -EAGAIN when they would sleep.
+ */
+static int pscull_nowait(struct kiocb *iocb)
+{
+	return (iocb->ki_filp->f_flags & O_NONBLOCK) || (iocb->ki_flags & IOCB_NOWAIT);
+}
+
+static int pscull_lock(struct pscull_dev *dev, int nowait)
+{
+	if (nowait)
+		return down_trylock(&dev->sem) ? -EAGAIN : 0;
+	if (down_interruptible(&dev->sem))
+		return -ERESTARTSYS;
+	return 0;
+}
+
+ssize_t pscull_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct pscull_dev *dev = iocb->ki_filp->private_data;
+	int nowait = pscull_nowait(iocb);
+	size_t count = iov_iter_count(to), copied;
+	int retval;
+
+	retval = pscull_lock(dev, nowait);
+	if (retval)
+		return retval;
+	while (dev->rp == dev->wp) {
+		up(&dev->sem);
+		if (nowait)
+			return -EAGAIN;
+    		printk(KERN_WARNING "\"%s\" reading: going to sleep\n", current->comm);
+		if (wait_event_interruptible(dev->inq, (dev->rp != dev->wp)))
+			return -ERESTARTSYS;
+		if (down_interruptible(&dev->sem))
+			return -ERESTARTSYS;
+	}
+	count = pscull_read_chunk(dev, count);
+	copied = copy_to_iter(dev->rp, count, to);
+	if (!copied && count) {
+		up (&dev->sem);
+		return -EFAULT;
+	}
+	pscull_read_done(dev, copied);
+	up(&dev->sem);
+	// keyed wakeups let io_uring's poll handler filter on the event
+	wake_up_interruptible_poll(&dev->outq, EPOLLOUT | EPOLLWRNORM);
+	PDEBUG("\"%s\" did read %li bytes\n", current->comm, (long)copied);
+	return copied;
+}
+
+int pscull_release(struct inode *inode, struct file *filp)
+{
+    return 0;
+}
+
+ssize_t pscull_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct pscull_dev *dev = iocb->ki_filp->private_data;
+	int nowait = pscull_nowait(iocb);
+	size_t count = iov_iter_count(from), copied;
+	int retval;
+
+	retval = pscull_lock(dev, nowait);
+	if (retval)
+		return retval;
+	while (pscull_spacefree(dev) == 0) {
+		up(&dev->sem);
+		if (nowait)
+			return -EAGAIN;
+		printk(KERN_INFO "\"%s\" writing: going to sleep\n", current->comm);
+		if (wait_event_interruptible(dev->outq, (pscull_spacefree(dev) > 0)))
+			return -ERESTARTSYS;
+		if (down_interruptible(&dev->sem))
+			return -ERESTARTSYS;
+	}
+	count = pscull_write_chunk(dev, count);
+	copied = copy_from_iter(dev->wp, count, from);
+	if (!copied && count) {
+		up(&dev->sem);
+		return -EFAULT;
+	}
+	pscull_write_done(dev, copied);
+	up(&dev->sem);
+	wake_up_interruptible_poll(&dev->inq, EPOLLIN | EPOLLRDNORM);
+	if (dev->async_queue)
+		kill_fasync(&dev->async_queue, SIGIO, POLL_IN);
+	PDEBUG("\"%s\" did write %li bytes\n", current->comm, (long)copied);
+	return copied;
+}
+
+static void pscull_setup_cdev(struct pscull_dev *dev, int index)
+{
+	int err, devno = MKDEV(pscull_major, pscull_minor + index);
+	// pscull's file operation structure
+	cdev_init(&dev->cdev, &pscull_fops);
+	dev->cdev.owner = THIS_MODULE;
+	printk(KERN_INFO "dev->cdev.ops = %p", (void *) &pscull_fops);
+	dev->cdev.ops = &pscull_fops;
+	err = cdev_add(&dev->cdev, devno, 1);
+	if ( err )
+		printk(KERN_NOTICE "Error %d adding pscull%d", err, index);
+}
+
+module_init(pscull_init);
+module_exit(pscull_exit);
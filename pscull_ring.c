@@ -0,0 +1,57 @@
+#include <linux/kernel.h>
+#include "pscull.h"
+
+/*
+ * The ring is buffer..end, end being one past the last byte. rp == wp means
+ * empty, so at most buffersize - 1 bytes are ever stored.
+ */
+void pscull_ring_init(struct pscull_dev *dev, char *buffer, int buffersize)
+{
+	dev->buffer = buffer;
+	dev->buffersize = buffersize;
+	dev->end = buffer + buffersize;
+	dev->rp = buffer;
+	dev->wp = buffer;
+}
+
+// How much space is free
+int pscull_spacefree(struct pscull_dev *dev)
+{
+	char *rp = READ_ONCE(dev->rp), *wp = READ_ONCE(dev->wp);
+
+	if (rp == wp)
+		return dev->buffersize - 1;
+	return ((rp + dev->buffersize - wp) % dev->buffersize) - 1;
+}
+
+// How much can be read from rp in one go, at most count
+size_t pscull_read_chunk(struct pscull_dev *dev, size_t count)
+{
+	if (dev->wp >= dev->rp)
+		return min(count, (size_t)(dev->wp - dev->rp));
+	// the data wraps, read up to the end first
+	return min(count, (size_t)(dev->end - dev->rp));
+}
+
+// How much can be written at wp in one go, at most count
+size_t pscull_write_chunk(struct pscull_dev *dev, size_t count)
+{
+	count = min(count, (size_t)pscull_spacefree(dev));
+	if (dev->wp >= dev->rp)
+		return min(count, (size_t)(dev->end - dev->wp));
+	return min(count, (size_t)(dev->rp - dev->wp - 1));
+}
+
+void pscull_read_done(struct pscull_dev *dev, size_t count)
+{
+	dev->rp += count;
+	if (dev->rp == dev->end)
+		dev->rp = dev->buffer; // wrapped
+}
+
+void pscull_write_done(struct pscull_dev *dev, size_t count)
+{
+	dev->wp += count;
+	if (dev->wp == dev->end)
+		dev->wp = dev->buffer; // wrapped
+}
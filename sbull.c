@@ -0,0 +1,288 @@
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include "sbull.h"
+
+MODULE_LICENSE("Dual BSD/GPL");
+
+// sbull block and blk-mq methods
+static void sbull_cleanup_module(void);
+static void sbull_exit(void);
+static int sbull_init_hctx(struct blk_mq_hw_ctx *hctx, void *data, unsigned int index);
+static void sbull_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int index);
+static blk_status_t sbull_queue_rq(struct blk_mq_hw_ctx *hctx, const struct blk_mq_queue_data *bd);
+static int sbull_setup_device(struct sbull_dev *dev, int index);
+static int sbull_transfer(struct scull_dev *store, loff_t pos, char *buf, unsigned int len, int write);
+
+struct sbull_dev *sbull_devs;
+
+int sbull_major = SBULL_MAJOR;
+int sbull_nr_devs = SBULL_NR_DEVS;
+int sbull_size_mb = SBULL_SIZE_MB;
+int sbull_nr_hw_queues = 0; // 0 means one per online CPU
+
+module_param(sbull_nr_devs, int, S_IRUGO);
+module_param(sbull_size_mb, int, S_IRUGO);
+module_param(sbull_nr_hw_queues, int, S_IRUGO);
+
+static struct blk_mq_ops sbull_mq_ops = {
+	.queue_rq = sbull_queue_rq,
+	.init_hctx = sbull_init_hctx,
+	.exit_hctx = sbull_exit_hctx,
+};
+
+static struct block_device_operations sbull_bdops = {
+	.owner = THIS_MODULE,
+};
+
+static int sbull_init(void)
+{
+	int i, result;
+
+	// a size <= 0 would give a negative capacity
+	if (sbull_size_mb <= 0 || sbull_nr_devs <= 0) {
+		printk(KERN_WARNING "sbull: bad size %d MB or device count %d\n",
+		       sbull_size_mb, sbull_nr_devs);
+		return -EINVAL;
+	}
+
+	result = register_blkdev(sbull_major, "sbull");
+	if (result < 0) {
+		printk(KERN_WARNING "sbull: can't get major %d\n", sbull_major);
+		return result;
+	}
+	if (sbull_major == 0)
+		sbull_major = result;
+	if (sbull_nr_hw_queues <= 0)
+		sbull_nr_hw_queues = num_online_cpus();
+
+	sbull_devs = kmalloc(sbull_nr_devs * sizeof(struct sbull_dev), GFP_KERNEL);
+	if (!sbull_devs) {
+		result = -ENOMEM;
+		goto fail;
+	}
+	memset(sbull_devs, 0, sbull_nr_devs * sizeof(struct sbull_dev));
+	for (i = 0; i < sbull_nr_devs; i++) {
+		result = sbull_setup_device(&sbull_devs[i], i);
+		if (result)
+			goto fail;
+	}
+
+	printk(KERN_INFO "init_module() called\n");
+	return 0;
+
+	fail:
+		sbull_cleanup_module();
+		return result;
+}
+
+static int sbull_setup_device(struct sbull_dev *dev, int index)
+{
+	int err;
+
+	dev->store.quantum = SBULL_QUANTUM;
+	dev->store.qset = SBULL_QSET;
+	dev->store.size = (loff_t)sbull_size_mb << 20;
+	sema_init(&dev->store.sem, 1);
+	init_rwsem(&dev->lock);
+
+	dev->tag_set.ops = &sbull_mq_ops;
+	dev->tag_set.nr_hw_queues = sbull_nr_hw_queues;
+	dev->tag_set.queue_depth = SBULL_QUEUE_DEPTH;
+	dev->tag_set.numa_node = NUMA_NO_NODE;
+	// queue_rq sleeps on the storage semaphore and allocates quanta
+	dev->tag_set.flags = BLK_MQ_F_SHOULD_MERGE | BLK_MQ_F_BLOCKING;
+	dev->tag_set.driver_data = dev;
+	err = blk_mq_alloc_tag_set(&dev->tag_set);
+	if (err) {
+		dev->tag_set.ops = NULL;
+		return err;
+	}
+
+	dev->queue = blk_mq_init_queue(&dev->tag_set);
+	if (IS_ERR(dev->queue)) {
+		err = PTR_ERR(dev->queue);
+		dev->queue = NULL;
+		return err;
+	}
+	dev->queue->queuedata = dev;
+	blk_queue_logical_block_size(dev->queue, SBULL_SECTOR_SIZE);
+	blk_queue_flag_set(QUEUE_FLAG_NONROT, dev->queue);
+	// discards free quanta, see scull_discard
+	dev->queue->limits.discard_granularity = SBULL_QUANTUM;
+	blk_queue_max_discard_sectors(dev->queue, UINT_MAX >> SECTOR_SHIFT);
+	blk_queue_max_write_zeroes_sectors(dev->queue, UINT_MAX >> SECTOR_SHIFT);
+	blk_queue_flag_set(QUEUE_FLAG_DISCARD, dev->queue);
+
+	dev->gd = alloc_disk(SBULL_MINORS);
+	if (!dev->gd)
+		return -ENOMEM;
+	dev->gd->major = sbull_major;
+	dev->gd->first_minor = index * SBULL_MINORS;
+	dev->gd->fops = &sbull_bdops;
+	dev->gd->queue = dev->queue;
+	dev->gd->private_data = dev;
+	snprintf(dev->gd->disk_name, DISK_NAME_LEN, "sbull%c", 'a' + index);
+	set_capacity(dev->gd, dev->store.size >> SECTOR_SHIFT);
+	add_disk(dev->gd);
+	return 0;
+}
+
+static void sbull_cleanup_module(void)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct sbull_hctx *ctx;
+	struct sbull_dev *dev;
+	int i, j;
+
+	printk(KERN_INFO "cleanup_module() called\n");
+	for (i = 0; sbull_devs && i < sbull_nr_devs; i++) {
+		dev = &sbull_devs[i];
+		if (dev->gd) {
+			if (dev->gd->flags & GENHD_FL_UP)
+				del_gendisk(dev->gd);
+			put_disk(dev->gd);
+		}
+		if (dev->queue) {
+			queue_for_each_hw_ctx(dev->queue, hctx, j) {
+				ctx = hctx->driver_data;
+				printk(KERN_INFO "sbull%c: hctx %d: %ld requests, %ld bytes\n",
+				       'a' + i, j, atomic_long_read(&ctx->requests),
+				       atomic_long_read(&ctx->bytes));
+			}
+			blk_cleanup_queue(dev->queue);
+		}
+		if (dev->tag_set.ops)
+			blk_mq_free_tag_set(&dev->tag_set);
+		scull_trim(&dev->store);
+	}
+	kfree(sbull_devs);
+	unregister_blkdev(sbull_major, "sbull");
+}
+
+static void sbull_exit(void)
+{
+	sbull_cleanup_module();
+	printk(KERN_INFO "exit_module() called\n");
+}
+
+// hardware queue contexts live on the node of the CPUs they are mapped to
+static int sbull_init_hctx(struct blk_mq_hw_ctx *hctx, void *data, unsigned int index)
+{
+	struct sbull_hctx *ctx;
+
+	ctx = kzalloc_node(sizeof(struct sbull_hctx), GFP_KERNEL, hctx->numa_node);
+	if (!ctx)
+		return -ENOMEM;
+	ctx->dev = data;
+	hctx->driver_data = ctx;
+	return 0;
+}
+
+static void sbull_exit_hctx(struct blk_mq_hw_ctx *hctx, unsigned int index)
+{
+	kfree(hctx->driver_data);
+	hctx->driver_data = NULL;
+}
+
+/*
+ * Copy one bio segment in or out of the quanta. Reads of holes give zeroes,
+ * writes allocate with GFP_NOIO so reclaim doesn't recurse into us.
+ */
+static int sbull_transfer(struct scull_dev *store, loff_t pos, char *buf, unsigned int len, int write)
+{
+	struct scull_qset *dptr;
+	struct scull_quantum *q;
+	unsigned int chunk;
+	u64 item;
+	int s_pos, q_pos;
+
+	while (len) {
+		scull_locate(store, pos, &item, &s_pos, &q_pos);
+		chunk = min_t(unsigned int, len, store->quantum - q_pos);
+		if (write) {
+			dptr = scull_follow(store, item, GFP_NOIO);
+			q = dptr ? scull_quantum_for_write(store, dptr, s_pos, GFP_NOIO) : NULL;
+			if (!q)
+				return -ENOMEM;
+			memcpy(q->data + q_pos, buf, chunk);
+		} else {
+			dptr = scull_lookup(store, item);
+			q = dptr && dptr->data ? dptr->data->quanta[s_pos] : NULL;
+			if (q)
+				memcpy(buf, q->data + q_pos, chunk);
+			else
+				memset(buf, 0, chunk);
+		}
+		pos += chunk;
+		buf += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+static blk_status_t sbull_queue_rq(struct blk_mq_hw_ctx *hctx, const struct blk_mq_queue_data *bd)
+{
+	struct sbull_hctx *ctx = hctx->driver_data;
+	struct sbull_dev *dev = ctx->dev;
+	struct scull_dev *store = &dev->store;
+	struct request *rq = bd->rq;
+	int reading = req_op(rq) == REQ_OP_READ;
+	loff_t pos = (loff_t)blk_rq_pos(rq) << SECTOR_SHIFT;
+	blk_status_t status = BLK_STS_OK;
+	struct req_iterator iter;
+	struct bio_vec bvec;
+	char *buf;
+	int err = 0;
+
+	blk_mq_start_request(rq);
+	if (pos + blk_rq_bytes(rq) > store->size) {
+		blk_mq_end_request(rq, BLK_STS_IOERR);
+		return BLK_STS_OK;
+	}
+
+	if (reading)
+		down_read(&dev->lock);
+	else
+		down_write(&dev->lock);
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+	case REQ_OP_WRITE:
+		rq_for_each_segment(bvec, rq, iter) {
+			// this is a loop per bio, a break only leaves the current one
+			if (err)
+				break;
+			// kmap, not kmap_atomic: writes may sleep allocating quanta
+			buf = kmap(bvec.bv_page) + bvec.bv_offset;
+			err = sbull_transfer(store, pos, buf, bvec.bv_len,
+					     req_op(rq) == REQ_OP_WRITE);
+			kunmap(bvec.bv_page);
+			pos += bvec.bv_len;
+		}
+		break;
+	case REQ_OP_DISCARD:
+	case REQ_OP_WRITE_ZEROES:
+		err = scull_discard(store, pos, blk_rq_bytes(rq));
+		break;
+	case REQ_OP_FLUSH:
+		break;
+	default:
+		status = BLK_STS_NOTSUPP;
+	}
+	if (reading)
+		up_read(&dev->lock);
+	else
+		up_write(&dev->lock);
+	atomic_long_inc(&ctx->requests);
+	atomic_long_add(blk_rq_bytes(rq), &ctx->bytes);
+
+	if (err)
+		status = errno_to_blk_status(err);
+	blk_mq_end_request(rq, status);
+	return BLK_STS_OK;
+}
+
+module_init(sbull_init);
+module_exit(sbull_exit);
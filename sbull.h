@@ -0,0 +1,57 @@
+#include <linux/blk-mq.h>
+#include <linux/blkdev.h>
+#include <linux/genhd.h>
+#include <linux/rwsem.h>
+#include "scull.h"
+
+#undef PDEBUG
+#ifdef SCULL_DEBUG
+#  ifdef __KERNEL__
+   // Debugging in the kernel space
+#    define PDEBUG(fmt, args...) fprintk( KERN_DEBUG "sbull: " fmt, ## args)
+#  else
+   // Debugging in the user space
+#    define PDEBUG(fmt, args...) fprintf(stderr, fmt, ## args)
+#  endif
+#else
+#  define PDEBUG(fmt, args...) //nothing
+#endif
+
+
+#define SBULL_MAJOR 0
+#define SBULL_NR_DEVS 1
+#define SBULL_MINORS 16
+#define SBULL_SIZE_MB 256
+#define SBULL_SECTOR_SIZE 512
+// quanta are pages so discards free whole quanta
+#define SBULL_QUANTUM PAGE_SIZE
+#define SBULL_QSET 1024
+#define SBULL_QUEUE_DEPTH 128
+
+struct sbull_dev;
+struct sbull_hctx;
+
+struct sbull_dev {
+	struct scull_dev store;		// same quantum/qset storage as scull
+	/*
+	 * Stands in for store.sem: reads only look quanta up and copy, so they
+	 * share it, anything that allocates or frees quanta takes it for write.
+	 */
+	struct rw_semaphore lock;
+	struct blk_mq_tag_set tag_set;
+	struct request_queue *queue;
+	struct gendisk *gd;
+};
+
+// per hardware queue context, one per CPU by default
+struct sbull_hctx {
+	struct sbull_dev *dev;
+	// atomic, requests on one hctx can run side by side under the read lock
+	atomic_long_t requests;
+	atomic_long_t bytes;
+};
+
+extern int sbull_major;
+extern int sbull_nr_devs;
+extern int sbull_size_mb;
+extern int sbull_nr_hw_queues;
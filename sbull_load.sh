@@ -0,0 +1,14 @@
+#!/bin/sh
+
+module="sbull"
+
+# sbull keeps its data in scull's quantum/qset storage
+grep -q '^scull ' /proc/modules || /sbin/insmod ./scull.ko || exit 1
+
+# invoke insmode with all arguments we got
+# and use a path name, as newer modutils don't look in . by default
+# the block nodes (/dev/sbulla, ...) are created by udev
+/sbin/insmod ./$module.ko $* || exit 1
+
+major=$(awk "\$2==\"$module\" {print \$1}" /proc/devices)
+echo "major $major"
@@ -1,6 +1,13 @@
-#include <asm/uaccess.h>
-#include <asm-generic/ioctl.h>
-#include <linux/fs.h>
+#ifdef __KERNEL__
+#  include <asm/uaccess.h>
+#  include <asm-generic/ioctl.h>
+#  include <linux/cdev.h>
+#  include <linux/fs.h>
+#  include <linux/semaphore.h>
+#else
+   // the ioctl interface is shared with user space tools
+#  include <linux/ioctl.h>
+#endif
 
 #undef PDEBUG
 #ifdef SCULL_DEBUG
@@ -38,43 +45,94 @@
 #define SCULL_IOCXQSET    _IOWR(SCULL_IOC_MAGIC, 10, int)
 #define SCULL_IOCHQUANTUM _IO(SCULL_IOC_MAGIC, 11)
 #define SCULL_IOCHQSET    _IO(SCULL_IOC_MAGIC, 12)
+// returns the minor of a new read-only snapshot of the device
+#define SCULL_IOCQSNAPSHOT _IO(SCULL_IOC_MAGIC, 13)
+// frees a snapshot, issued on the snapshot minor itself
+#define SCULL_IOCDROPSNAP  _IO(SCULL_IOC_MAGIC, 14)
+// S on a device open for writing trims it and pre-sizes it to the geometry;
+// a quantum or qset other than the current defaults needs CAP_SYS_ADMIN
+#define SCULL_IOCGGEOMETRY _IOR(SCULL_IOC_MAGIC, 15, struct scull_geometry)
+#define SCULL_IOCSGEOMETRY _IOW(SCULL_IOC_MAGIC, 16, struct scull_geometry)
+// where the device's quanta are allocated, see SCULL_NUMA_*
+#define SCULL_IOCGNUMA _IOR(SCULL_IOC_MAGIC, 17, struct scull_numa)
+#define SCULL_IOCSNUMA _IOW(SCULL_IOC_MAGIC, 18, struct scull_numa)
+
+#define SCULL_IOC_MAXNR 18
+
+struct scull_geometry {
+    int quantum;
+    int qset;
+    long long size;
+};
+
+#define SCULL_NUMA_LOCAL 0      // first touch, on the writer's node
+#define SCULL_NUMA_BIND 1       // all on one node
+#define SCULL_NUMA_INTERLEAVE 2 // round robin over the online nodes
 
-#define SCULL_IOC_MAXNR 14
+struct scull_numa {
+    int policy;
+    int node;   // for SCULL_NUMA_BIND
+};
 
 #define SCULL_MAJOR 0
 #define SCULL_MINOR 0
 #define SCULL_NR_DEVS 4
+#define SCULL_NR_SNAPS 4
 #define SCULL_QUANTUM 4000
 #define SCULL_QSET 1000
+#define SCULL_MAX_SIZE (1ULL << 32) // writes past this get -EFBIG
 
-// scull device number
-dev_t dev_no;
+#ifdef __KERNEL__
 
-// scull's file operation structure forward declaration 
-struct file_operations scull_fops;
 struct scull_dev;
 struct scull_qset;
+struct scull_qdata;
+struct scull_quantum;
 
-// scull_fops methods
-long scull_unlocked_ioctl(struct file *flip, unsigned int cmd, unsigned long arg);
-static int scull_proc_open(struct inode *inode, struct file *file);
-static void *scull_seq_start(struct seq_file *s, loff_t *pos);
-void scull_seq_stop(struct seq_file *s, void *v);
-static void *scull_seq_next(struct seq_file *s, void *v, loff_t *pos);
-int scull_seq_show(struct seq_file *s, void *v);
-static void scull_cleanup_module(void);
-static void scull_exit(void);
-struct scull_qset *scull_follow(struct scull_dev *dev, int n);
-int scull_open(struct inode *inode, struct file *filp);
-ssize_t scull_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos);
-int scull_release(struct inode *inode, struct file *filp);
-loff_t scull_llseek(struct file *filp, loff_t off, int whence);
-static void scull_setup_cdev(struct scull_dev *dev, int index);
+/*
+ * Quantum/qset storage (scull_core.c), exported for other drivers built on
+ * it (sbull). Callers hold dev->sem.
+ */
+struct scull_qset *scull_follow(struct scull_dev *dev, u64 n, gfp_t gfp);
+struct scull_qset *scull_lookup(struct scull_dev *dev, u64 n);
+void scull_locate(struct scull_dev *dev, loff_t pos, u64 *item, int *s_pos, int *q_pos);
+int scull_numa_valid(int policy, int node);
+struct scull_quantum *scull_alloc_quantum(struct scull_dev *dev, gfp_t gfp);
+void scull_put_quantum(struct scull_quantum *q);
+struct scull_qdata *scull_alloc_qdata(int qset, gfp_t gfp);
+void scull_put_qdata(struct scull_qdata *qd, int qset);
+struct scull_qdata *scull_qdata_for_write(struct scull_dev *dev, struct scull_qset *dptr, gfp_t gfp);
+struct scull_quantum *scull_quantum_for_write(struct scull_dev *dev, struct scull_qset *dptr, int s_pos, gfp_t gfp);
+int scull_snapshot(struct scull_dev *snap, struct scull_dev *dev);
+int scull_presize(struct scull_dev *dev, loff_t size);
+int scull_discard(struct scull_dev *dev, loff_t pos, loff_t len);
 int scull_trim(struct scull_dev *dev);
-ssize_t scull_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos);
+
+// moves len bytes between quantum data and ctx, returns how many it moved
+typedef size_t (*scull_copy_t)(void *data, size_t len, void *ctx);
+ssize_t scull_read_at(struct scull_dev *dev, loff_t *f_pos, size_t count,
+                      scull_copy_t copy, void *ctx);
+ssize_t scull_write_at(struct scull_dev *dev, loff_t *f_pos, size_t count,
+                       scull_copy_t copy, void *ctx, gfp_t gfp);
+
+/*
+ * Quanta and qset arrays are refcounted so snapshots can share them. The
+ * quantum data is an allocation of its own: a count in front of it would
+ * push every power-of-two quantum into the next size class.
+ */
+struct scull_quantum {
+    atomic_t count;
+    char *data;
+    atomic_long_t *node_count; // entry of the allocating dev's node_quanta, or NULL
+};
+
+struct scull_qdata {
+    atomic_t count;
+    struct scull_quantum *quanta[];
+};
 
 struct scull_qset {
-    void **data;
+    struct scull_qdata *data;
     struct scull_qset *next;
 };
 
@@ -82,17 +140,30 @@ struct scull_dev {
     struct scull_qset *data;
     int quantum;
     int qset;
-    unsigned long size;
+    loff_t size;
     unsigned int access_key;
+    int readonly;  // snapshot minor
+    int in_use;    // snapshot minor holds a snapshot
+    int numa_policy;
+    int numa_node;
+    int numa_next; // last node used by SCULL_NUMA_INTERLEAVE
+    /*
+     * quanta this device allocated that still exist, per node, if not NULL.
+     * Quanta shared with a snapshot stay counted here until freed.
+     */
+    atomic_long_t *node_quanta;
     struct semaphore sem;
     struct cdev cdev;
 };
 
-//struct scull_dev dev;
-struct scull_dev *scull_devs;
-
 extern int scull_major;
 extern int scull_minor;
 extern int scull_nr_devs;
+extern int scull_nr_snaps;
 extern int scull_quantum;
 extern int scull_qset;
+extern unsigned long long scull_max_size;
+extern int scull_numa_policy;
+extern int scull_numa_node;
+
+#endif /* __KERNEL__ */
@@ -0,0 +1,491 @@
+/*
+ * scull's storage: the qset list, quanta and the offset math, without any of
+ * the file_operations glue (scull_main.c). Builds as part of scull.ko and,
+ * against userspace/include, as a user space library for benchmarks and
+ * fuzzing.
+ */
+#include <linux/cdev.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/semaphore.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include "scull.h"
+
+// geometry a device goes back to when trimmed
+int scull_quantum = SCULL_QUANTUM;
+int scull_qset = SCULL_QSET;
+
+/*
+ * Bounds the list walks below: with small quanta even a few GB of offset
+ * are millions of list items.
+ */
+unsigned long long scull_max_size = SCULL_MAX_SIZE;
+
+/*
+ * Return list item n, growing the list as needed. Items added by a call
+ * that then fails are freed again. Only __GFP_FS callers (the char device
+ * path, on behalf of the calling task) give up on a fatal signal; block I/O
+ * (GFP_NOIO from sbull) runs in whatever task dispatches it and must not
+ * fail because that task is dying.
+ */
+struct scull_qset *scull_follow(struct scull_dev *dev, u64 n, gfp_t gfp)
+{
+    struct scull_qset *qset = dev->data, *grown = NULL, *next;
+
+    // allocate first qset explicitly if need be
+    if (!qset) {
+        qset = kmalloc(sizeof(struct scull_qset), gfp);
+        if (!qset)
+            return NULL;
+        memset(qset, 0, sizeof(struct scull_qset));
+        dev->data = qset;
+    }
+
+    // then follow the list
+    while (n--) {
+        if ((gfp & __GFP_FS) && fatal_signal_pending(current))
+            goto fail;
+        cond_resched();
+        if (!qset->next) {
+            qset->next = kmalloc(sizeof(struct scull_qset), gfp);
+            if (!qset->next)
+                goto fail;
+            memset(qset->next, 0, sizeof(struct scull_qset));
+            if (!grown)
+                grown = qset;
+        }
+        qset = qset->next;
+    }
+    return qset;
+
+  fail:
+    // the new items hold no data yet
+    for (qset = grown ? grown->next : NULL; qset; qset = next) {
+        next = qset->next;
+        kfree(qset);
+    }
+    if (grown)
+        grown->next = NULL;
+    return NULL;
+}
+EXPORT_SYMBOL(scull_follow);
+
+// like scull_follow, but returns NULL instead of growing the list
+struct scull_qset *scull_lookup(struct scull_dev *dev, u64 n)
+{
+    struct scull_qset *qset = dev->data;
+
+    while (qset && n--)
+        qset = qset->next;
+    return qset;
+}
+EXPORT_SYMBOL(scull_lookup);
+
+/*
+ * Split a device offset into list item, index in the qset and offset in the
+ * quantum. quantum * qset may not fit in an int and offsets may be past 2GB,
+ * so everything goes through 64-bit division (plain '/' on u64 doesn't link
+ * on 32-bit kernels).
+ */
+void scull_locate(struct scull_dev *dev, loff_t pos, u64 *item, int *s_pos, int *q_pos)
+{
+    u64 itemsize = (u64) dev->quantum * dev->qset;
+    u64 rest;
+    u32 q;
+
+    *item = div64_u64_rem(pos, itemsize, &rest);
+    *s_pos = div_u64_rem(rest, dev->quantum, &q);
+    *q_pos = q;
+}
+EXPORT_SYMBOL(scull_locate);
+
+int scull_numa_valid(int policy, int node)
+{
+    switch (policy) {
+        case SCULL_NUMA_LOCAL:
+        case SCULL_NUMA_INTERLEAVE:
+          return 1;
+        case SCULL_NUMA_BIND:
+          return node >= 0 && node < nr_node_ids && node_online(node);
+    }
+    return 0;
+}
+
+// node the next quantum of dev should go to. Caller holds dev->sem.
+static int scull_quantum_node(struct scull_dev *dev)
+{
+    switch (dev->numa_policy) {
+        case SCULL_NUMA_BIND:
+          return dev->numa_node;
+        case SCULL_NUMA_INTERLEAVE:
+          dev->numa_next = next_online_node(dev->numa_next);
+          if (dev->numa_next >= MAX_NUMNODES)
+              dev->numa_next = first_online_node;
+          return dev->numa_next;
+    }
+    return numa_node_id();
+}
+
+/*
+ * Quanta bigger than a few pages are hard to get physically contiguous,
+ * kvmalloc falls back to vmalloc for those. kvmalloc only takes GFP_KERNEL
+ * compatible flags, GFP_NOWAIT/GFP_NOIO callers only get the kmalloc part.
+ * The data is exactly dev->quantum bytes, so page sized and power-of-two
+ * quanta don't waste a size class. The node comes from the device's NUMA
+ * policy; the node the data really landed on is what gets counted, until
+ * scull_put_quantum frees it.
+ */
+struct scull_quantum *scull_alloc_quantum(struct scull_dev *dev, gfp_t gfp)
+{
+    struct scull_quantum *q;
+    struct page *page;
+    int node = scull_quantum_node(dev);
+
+    q = kmalloc_node(sizeof(struct scull_quantum), gfp, node);
+    if (!q)
+        return NULL;
+    if ((gfp & GFP_KERNEL) == GFP_KERNEL)
+        q->data = kvmalloc_node(dev->quantum, gfp, node);
+    else if ((size_t)dev->quantum <= KMALLOC_MAX_SIZE)
+        q->data = kmalloc_node(dev->quantum, gfp, node);
+    else
+        q->data = NULL; // only kvmalloc could, don't even ask kmalloc
+    if (!q->data) {
+        kfree(q);
+        return NULL;
+    }
+    atomic_set(&q->count, 1);
+    q->node_count = NULL;
+    if (dev->node_quanta) {
+        page = is_vmalloc_addr(q->data) ? vmalloc_to_page(q->data) : virt_to_page(q->data);
+        q->node_count = &dev->node_quanta[page_to_nid(page)];
+        atomic_long_inc(q->node_count);
+    }
+    return q;
+}
+
+void scull_put_quantum(struct scull_quantum *q)
+{
+    if (q && atomic_dec_and_test(&q->count)) {
+        // may be another device's counter when a snapshot frees it
+        if (q->node_count)
+            atomic_long_dec(q->node_count);
+        kvfree(q->data);
+        kfree(q);
+    }
+}
+EXPORT_SYMBOL(scull_put_quantum);
+
+struct scull_qdata *scull_alloc_qdata(int qset, gfp_t gfp)
+{
+    struct scull_qdata *qd;
+
+    qd = kmalloc(sizeof(struct scull_qdata) + qset * sizeof(struct scull_quantum *), gfp);
+    if (!qd)
+        return NULL;
+    memset(qd, 0, sizeof(struct scull_qdata) + qset * sizeof(struct scull_quantum *));
+    atomic_set(&qd->count, 1);
+    return qd;
+}
+
+void scull_put_qdata(struct scull_qdata *qd, int qset)
+{
+    int i;
+
+    if (!qd || !atomic_dec_and_test(&qd->count))
+        return;
+    for (i = 0; i < qset; i++)
+        scull_put_quantum(qd->quanta[i]);
+    kfree(qd);
+}
+
+/*
+ * Return the qset array of dptr ready to be modified: allocate it, or take a
+ * private copy if it is shared with snapshots. Caller holds dev->sem.
+ */
+struct scull_qdata *scull_qdata_for_write(struct scull_dev *dev, struct scull_qset *dptr, gfp_t gfp)
+{
+    struct scull_qdata *qd = dptr->data;
+    int i;
+
+    if (!qd) {
+        qd = scull_alloc_qdata(dev->qset, gfp);
+        if (!qd)
+            return NULL;
+        dptr->data = qd;
+    } else if (atomic_read(&qd->count) > 1) {
+        qd = scull_alloc_qdata(dev->qset, gfp);
+        if (!qd)
+            return NULL;
+        for (i = 0; i < dev->qset; i++) {
+            qd->quanta[i] = dptr->data->quanta[i];
+            if (qd->quanta[i])
+                atomic_inc(&qd->quanta[i]->count);
+        }
+        scull_put_qdata(dptr->data, dev->qset);
+        dptr->data = qd;
+    }
+    return qd;
+}
+EXPORT_SYMBOL(scull_qdata_for_write);
+
+/*
+ * Return quantum s_pos of dptr ready to be written: allocate it if it's a
+ * hole, or break the sharing with snapshots. Only the qset array and the
+ * quantum being touched are copied. Caller holds dev->sem.
+ */
+struct scull_quantum *scull_quantum_for_write(struct scull_dev *dev, struct scull_qset *dptr, int s_pos, gfp_t gfp)
+{
+    struct scull_qdata *qd;
+    struct scull_quantum *q;
+
+    qd = scull_qdata_for_write(dev, dptr, gfp);
+    if (!qd)
+        return NULL;
+
+    q = qd->quanta[s_pos];
+    if (!q) {
+        q = scull_alloc_quantum(dev, gfp);
+        if (!q)
+            return NULL;
+        qd->quanta[s_pos] = q;
+    } else if (atomic_read(&q->count) > 1) {
+        q = scull_alloc_quantum(dev, gfp);
+        if (!q)
+            return NULL;
+        memcpy(q->data, qd->quanta[s_pos]->data, dev->quantum);
+        scull_put_quantum(qd->quanta[s_pos]);
+        qd->quanta[s_pos] = q;
+    }
+    return q;
+}
+EXPORT_SYMBOL(scull_quantum_for_write);
+
+/*
+ * Make snap a copy of dev sharing all of its qset arrays, so the cost is one
+ * list node per qset. Caller holds both semaphores and snap is empty.
+ */
+int scull_snapshot(struct scull_dev *snap, struct scull_dev *dev)
+{
+    struct scull_qset *dptr, *sptr, **tail = &snap->data;
+
+    snap->quantum = dev->quantum;
+    snap->qset = dev->qset;
+    for (dptr = dev->data; dptr; dptr = dptr->next) {
+        sptr = kmalloc(sizeof(struct scull_qset), GFP_KERNEL);
+        if (!sptr) {
+            scull_trim(snap);
+            return -ENOMEM;
+        }
+        sptr->data = dptr->data;
+        if (sptr->data)
+            atomic_inc(&sptr->data->count);
+        sptr->next = NULL;
+        *tail = sptr;
+        tail = &sptr->next;
+    }
+    snap->size = dev->size;
+    return 0;
+}
+
+/*
+ * Build the list and the qset arrays covering size bytes and set the device
+ * size, so a restore only has to fill in quanta. Sizes past scull_max_size
+ * get -EFBIG, as writes there would. Caller holds dev->sem.
+ */
+int scull_presize(struct scull_dev *dev, loff_t size)
+{
+    struct scull_qset *dptr;
+    u64 item;
+    int s_pos, q_pos;
+
+    if ((u64)size > scull_max_size)
+        return -EFBIG;
+    if (size) {
+        scull_locate(dev, size - 1, &item, &s_pos, &q_pos);
+        if (!scull_follow(dev, item, GFP_KERNEL))
+            return -ENOMEM;
+        for (dptr = dev->data; dptr; dptr = dptr->next) {
+            if (fatal_signal_pending(current))
+                return -EINTR;
+            cond_resched();
+            if (!dptr->data)
+                dptr->data = scull_alloc_qdata(dev->qset, GFP_KERNEL);
+            if (!dptr->data)
+                return -ENOMEM;
+        }
+    }
+    dev->size = size;
+    return 0;
+}
+
+/*
+ * Throw away len bytes at pos. Quanta covered entirely are freed and become
+ * holes, partially covered ones are zeroed. Nothing is allocated for ranges
+ * that are holes already. Caller holds dev->sem.
+ */
+int scull_discard(struct scull_dev *dev, loff_t pos, loff_t len)
+{
+    struct scull_qset *dptr;
+    struct scull_qdata *qd;
+    struct scull_quantum *q;
+    u64 item;
+    int s_pos, q_pos, chunk;
+
+    while (len > 0) {
+        scull_locate(dev, pos, &item, &s_pos, &q_pos);
+        chunk = min_t(loff_t, len, dev->quantum - q_pos);
+        dptr = scull_lookup(dev, item);
+        if (dptr && dptr->data && dptr->data->quanta[s_pos]) {
+            if (chunk == dev->quantum) {
+                qd = scull_qdata_for_write(dev, dptr, GFP_NOIO);
+                if (!qd)
+                    return -ENOMEM;
+                scull_put_quantum(qd->quanta[s_pos]);
+                qd->quanta[s_pos] = NULL;
+            } else {
+                q = scull_quantum_for_write(dev, dptr, s_pos, GFP_NOIO);
+                if (!q)
+                    return -ENOMEM;
+                memset(q->data + q_pos, 0, chunk);
+            }
+        }
+        pos += chunk;
+        len -= chunk;
+    }
+    return 0;
+}
+EXPORT_SYMBOL(scull_discard);
+
+/*
+ * The copy loops behind read_iter/write_iter, one quantum at a time. copy
+ * moves len bytes between the quantum and ctx (an iov_iter in the driver, a
+ * plain buffer in user space builds) and returns how much it moved. Both
+ * stop at a short copy, reads also at EOF and at holes. Reads never
+ * allocate, a missing list item is a hole too. They return the bytes moved,
+ * or -EFAULT/-ENOMEM if nothing could be. Writes are cut at scull_max_size
+ * and get -EFBIG starting at or past it. Caller holds dev->sem.
+ */
+ssize_t scull_read_at(struct scull_dev *dev, loff_t *f_pos, size_t count,
+                      scull_copy_t copy, void *ctx)
+{
+    struct scull_qset *dptr = NULL;
+    struct scull_quantum *q;
+    loff_t pos = *f_pos;
+    size_t chunk, copied;
+    u64 item, cur_item = 0;
+    int s_pos, q_pos;
+    ssize_t retval = 0;
+
+    while ( count && pos < dev->size ) {
+        chunk = min_t(u64, count, dev->size - pos);
+
+        // find listitem, qset index, and offset in the quantum
+        scull_locate(dev, pos, &item, &s_pos, &q_pos);
+
+        // stay on the current list item, don't walk from the head every time
+        if ( !dptr || item != cur_item ) {
+            if ( dptr && item == cur_item + 1 && dptr->next )
+                dptr = dptr->next;
+            else
+                dptr = scull_lookup(dev, item);
+            cur_item = item;
+        }
+        if ( !dptr || !dptr->data || !(q = dptr->data->quanta[s_pos]) )
+            break; //don't fill holes
+
+        // read only up to the end of this quantum
+        chunk = min_t(size_t, chunk, dev->quantum - q_pos);
+        copied = copy(q->data + q_pos, chunk, ctx);
+        pos += copied;
+        count -= copied;
+        retval += copied;
+        if ( copied < chunk ) {
+            if ( !retval )
+                retval = -EFAULT;
+            break;
+        }
+    }
+    *f_pos = pos;
+    return retval;
+}
+
+ssize_t scull_write_at(struct scull_dev *dev, loff_t *f_pos, size_t count,
+                       scull_copy_t copy, void *ctx, gfp_t gfp)
+{
+    struct scull_qset *dptr = NULL;
+    struct scull_quantum *q;
+    loff_t pos = *f_pos;
+    size_t chunk, copied;
+    u64 item, cur_item = 0;
+    int s_pos, q_pos;
+    ssize_t retval = 0;
+
+    if ( count && (u64)pos >= scull_max_size )
+        return -EFBIG;
+    count = min_t(u64, count, scull_max_size - pos);
+
+    while ( count ) {
+        // find listitem, qset index, and offset in the quantum
+        scull_locate(dev, pos, &item, &s_pos, &q_pos);
+
+        if ( !dptr || item != cur_item ) {
+            if ( dptr && item == cur_item + 1 && dptr->next )
+                dptr = dptr->next;
+            else
+                dptr = scull_follow(dev, item, gfp);
+            cur_item = item;
+        }
+        // allocates holes and copies quanta still shared with a snapshot
+        q = dptr ? scull_quantum_for_write(dev, dptr, s_pos, gfp) : NULL;
+        if ( !q ) {
+            if ( !retval )
+                retval = -ENOMEM;
+            break;
+        }
+
+        // write only up to the end of this quantum
+        chunk = min_t(size_t, count, dev->quantum - q_pos);
+        copied = copy(q->data + q_pos, chunk, ctx);
+        pos += copied;
+        count -= copied;
+        retval += copied;
+        if ( copied < chunk ) {
+            if ( !retval )
+                retval = -EFAULT;
+            break;
+        }
+    }
+    *f_pos = pos;
+
+    // update the size, a failed or empty write doesn't grow the device
+    if ( retval > 0 && dev->size < pos )
+        dev->size = pos;
+    return retval;
+}
+
+int scull_trim(struct scull_dev *dev)
+{
+    struct scull_qset *next, *dptr;
+    int qset = dev->qset; // "dev" is not null
+    for (dptr = dev->data; dptr; dptr = next) { // all list items
+        // quanta still used by a snapshot (or its source) stay around
+        scull_put_qdata(dptr->data, qset);
+        dptr->data = NULL;
+        next = dptr->next;
+        kfree(dptr);
+    }
+    dev->size = 0;
+    dev->quantum = scull_quantum;
+    dev->qset = scull_qset;
+    dev->data = NULL;
+    return 0;
+}
+EXPORT_SYMBOL(scull_trim);
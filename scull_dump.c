@@ -0,0 +1,323 @@
+/*
+ * Save and restore the contents of a scull device.
+ *
+ *   scull_dump save /dev/scull0 > scull0.img
+ *   scull_dump restore /dev/scull0 < scull0.img
+ *
+ * Saving a snapshot minor (see SCULL_IOCQSNAPSHOT) gives a consistent image
+ * while writers keep using the source device.
+ *
+ * The image is a stream: a header with the device geometry and size, then
+ * one record per quantum that holds data (holes are skipped), then an end
+ * marker. A record is the quantum index followed by the quantum contents,
+ * the last quantum being cut at the device size. Numbers are in host byte
+ * order.
+ *
+ * Restore pre-sizes the device with SCULL_IOCSGEOMETRY (as root when the
+ * image geometry isn't the module's default) and then writes runs
+ * of consecutive quanta with one pwritev() each. When the image is a regular
+ * file it is mmap'd and the iovecs point straight into the mapping.
+ */
+#define _GNU_SOURCE // IOV_MAX
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "scull.h"
+
+#define SCULL_IMAGE_MAGIC "SCLI"
+#define SCULL_IMAGE_VERSION 1
+#define SCULL_IMAGE_END UINT64_MAX
+
+// upper bound on the bytes moved by one pwritev()
+#define BATCH_BYTES (64 << 20)
+
+struct scull_image_header {
+    char magic[4];
+    uint32_t version;
+    int32_t quantum;
+    int32_t qset;
+    int64_t size;
+};
+
+// where restore reads the image from
+struct source {
+    int fd;
+    char *map;      // whole image when it could be mmap'd
+    size_t map_len;
+    size_t off;
+};
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len) {
+        n = write(fd, p, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static ssize_t read_full(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < len) {
+        n = read(fd, p + done, len - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return -1;
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
+
+/*
+ * Get the next len bytes of the image. With a mapping *where points into it
+ * and nothing is copied, otherwise the bytes are read into buf.
+ */
+static int source_get(struct source *src, void *buf, size_t len, char **where)
+{
+    if (src->map) {
+        if (src->map_len - src->off < len)
+            return -1;
+        *where = src->map + src->off;
+        src->off += len;
+        return 0;
+    }
+    if (read_full(src->fd, buf, len) != (ssize_t)len)
+        return -1;
+    *where = buf;
+    return 0;
+}
+
+static size_t quantum_len(const struct scull_image_header *hdr, uint64_t index)
+{
+    uint64_t left = hdr->size - index * hdr->quantum;
+
+    return left < (uint64_t)hdr->quantum ? left : hdr->quantum;
+}
+
+static int scull_save(const char *path)
+{
+    struct scull_geometry geo;
+    struct scull_image_header hdr;
+    uint64_t index, nquanta, end = SCULL_IMAGE_END;
+    char *buf;
+    ssize_t n;
+    size_t len;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    if (ioctl(fd, SCULL_IOCGGEOMETRY, &geo) < 0) {
+        perror("SCULL_IOCGGEOMETRY");
+        return 1;
+    }
+    memcpy(hdr.magic, SCULL_IMAGE_MAGIC, sizeof(hdr.magic));
+    hdr.version = SCULL_IMAGE_VERSION;
+    hdr.quantum = geo.quantum;
+    hdr.qset = geo.qset;
+    hdr.size = geo.size;
+    if (write_all(STDOUT_FILENO, &hdr, sizeof(hdr)) < 0) {
+        perror("write");
+        return 1;
+    }
+
+    buf = malloc(geo.quantum);
+    if (!buf) {
+        perror("malloc");
+        return 1;
+    }
+    nquanta = (geo.size + geo.quantum - 1) / geo.quantum;
+    for (index = 0; index < nquanta; index++) {
+        len = quantum_len(&hdr, index);
+        // a read starting on a hole returns 0, it never runs past a quantum here
+        n = pread(fd, buf, len, (off_t)(index * geo.quantum));
+        if (n < 0) {
+            perror("pread");
+            return 1;
+        }
+        if (n == 0)
+            continue;
+        if ((size_t)n < len)
+            memset(buf + n, 0, len - n);
+        if (write_all(STDOUT_FILENO, &index, sizeof(index)) < 0 ||
+            write_all(STDOUT_FILENO, buf, len) < 0) {
+            perror("write");
+            return 1;
+        }
+    }
+    if (write_all(STDOUT_FILENO, &end, sizeof(end)) < 0) {
+        perror("write");
+        return 1;
+    }
+    free(buf);
+    close(fd);
+    return 0;
+}
+
+static int flush_batch(int fd, struct iovec *iov, int cnt, off_t pos)
+{
+    ssize_t n;
+
+    while (cnt) {
+        n = pwritev(fd, iov, cnt, pos);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        pos += n;
+        // skip what went through, a short write leaves a partial iovec
+        while (cnt && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+static int scull_restore(const char *path)
+{
+    struct scull_image_header hdr;
+    struct scull_geometry geo;
+    struct source src = { .fd = STDIN_FILENO };
+    struct iovec *iov;
+    struct stat st;
+    uint64_t index, nquanta, next = 0;
+    char *hdrp, *batch, *where;
+    int fd, cnt = 0, max_cnt;
+    off_t pos = 0;
+    size_t len;
+
+    if (fstat(src.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        src.map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, src.fd, 0);
+        if (src.map == MAP_FAILED)
+            src.map = NULL;
+        else
+            src.map_len = st.st_size;
+    }
+
+    if (source_get(&src, &hdr, sizeof(hdr), &hdrp) < 0) {
+        fprintf(stderr, "short image header\n");
+        return 1;
+    }
+    if (hdrp != (char *)&hdr)
+        memcpy(&hdr, hdrp, sizeof(hdr));
+    if (memcmp(hdr.magic, SCULL_IMAGE_MAGIC, sizeof(hdr.magic)) ||
+        hdr.version != SCULL_IMAGE_VERSION || hdr.quantum <= 0 ||
+        hdr.qset <= 0 || hdr.size < 0) {
+        fprintf(stderr, "not a scull image\n");
+        return 1;
+    }
+    nquanta = ((uint64_t)hdr.size + hdr.quantum - 1) / hdr.quantum;
+
+    fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    geo.quantum = hdr.quantum;
+    geo.qset = hdr.qset;
+    geo.size = hdr.size;
+    if (ioctl(fd, SCULL_IOCSGEOMETRY, &geo) < 0) {
+        perror("SCULL_IOCSGEOMETRY");
+        return 1;
+    }
+
+    max_cnt = BATCH_BYTES / hdr.quantum;
+    if (max_cnt > IOV_MAX)
+        max_cnt = IOV_MAX;
+    if (max_cnt < 1)
+        max_cnt = 1;
+    iov = calloc(max_cnt, sizeof(*iov));
+    // the staging buffer is only used when the image is streamed
+    batch = src.map ? NULL : malloc((size_t)max_cnt * hdr.quantum);
+    if (!iov || (!src.map && !batch)) {
+        perror("malloc");
+        return 1;
+    }
+
+    for (;;) {
+        if (source_get(&src, &index, sizeof(index), &where) < 0) {
+            fprintf(stderr, "truncated image\n");
+            return 1;
+        }
+        if (where != (char *)&index)
+            memcpy(&index, where, sizeof(index));
+        // a run of consecutive quanta goes out in one pwritev()
+        if (cnt && (index == SCULL_IMAGE_END || index != next || cnt == max_cnt)) {
+            if (flush_batch(fd, iov, cnt, pos) < 0) {
+                perror("pwritev");
+                return 1;
+            }
+            cnt = 0;
+        }
+        if (index == SCULL_IMAGE_END)
+            break;
+        // index * quantum could wrap for a crafted index
+        if (index >= nquanta) {
+            fprintf(stderr, "quantum %llu past the device size\n",
+                    (unsigned long long)index);
+            return 1;
+        }
+        len = quantum_len(&hdr, index);
+        if (source_get(&src, batch ? batch + (size_t)cnt * hdr.quantum : NULL,
+                       len, &where) < 0) {
+            fprintf(stderr, "truncated image\n");
+            return 1;
+        }
+        if (!cnt)
+            pos = (off_t)(index * hdr.quantum);
+        iov[cnt].iov_base = where;
+        iov[cnt].iov_len = len;
+        cnt++;
+        next = index + 1;
+    }
+
+    free(batch);
+    free(iov);
+    if (src.map)
+        munmap(src.map, src.map_len);
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc == 3 && !strcmp(argv[1], "save"))
+        return scull_save(argv[2]);
+    if (argc == 3 && !strcmp(argv[1], "restore"))
+        return scull_restore(argv[2]);
+    fprintf(stderr, "usage: %s save|restore DEVICE\n", argv[0]);
+    return 2;
+}
@@ -4,13 +4,14 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
+#include "scull.h"
 
 int main() {
 
     int quantum;
     int fd = open("/dev/scull0", O_APPEND);
     printf("%i\n", fd);
-    quantum = ioctl(fd, 65031);
+    quantum = ioctl(fd, SCULL_IOCQQUANTUM);
     close(fd);
     printf("%i\n", quantum);
     return 0;
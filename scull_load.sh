@@ -9,7 +9,7 @@ mode="644"
 /sbin/insmod ./$module.ko $* || exit 1
 
 # remove stale nodes
-rm -f /dev/${device}[0-3]
+rm -f /dev/${device}[0-3] /dev/${device}snap[0-3]
 
 major=$(awk "\$2==\"$module\" {print \$1}" /proc/devices)
 echo "major $major"
@@ -19,10 +19,16 @@ mknod /dev/${device}1 c $major 1
 mknod /dev/${device}2 c $major 2
 mknod /dev/${device}3 c $major 3
 
+# read-only snapshot minors, see SCULL_IOCQSNAPSHOT
+mknod /dev/${device}snap0 c $major 4
+mknod /dev/${device}snap1 c $major 5
+mknod /dev/${device}snap2 c $major 6
+mknod /dev/${device}snap3 c $major 7
+
 # give appropriate group/permission, and change the group.
 # Not all distributions have staff, some have "wheel" instead
 group="staff"
 grep -q '^staff:' /etc/group || group="wheel"
 
-chgrp $group /dev/${device}[0-3]
-chmod $mode /dev/${device}[0-3]
+chgrp $group /dev/${device}[0-3] /dev/${device}snap[0-3]
+chmod $mode /dev/${device}[0-3] /dev/${device}snap[0-3]
@@ -0,0 +1,538 @@
+#include <asm/uaccess.h>
+#include <linux/cdev.h>
+#include <linux/errno.h>
+#include <linux/fs.h>
+#include <linux/ioctl.h>
+#include <linux/proc_fs.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/nodemask.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/uio.h>
+#include "scull.h"
+
+MODULE_LICENSE("Dual BSD/GPL");
+
+// scull device number
+dev_t dev_no;
+
+// scull's file operation structure forward declaration 
+struct file_operations scull_fops;
+
+// scull_fops methods
+long scull_unlocked_ioctl(struct file *flip, unsigned int cmd, unsigned long arg);
+static int scull_proc_open(struct inode *inode, struct file *file);
+static void *scull_seq_start(struct seq_file *s, loff_t *pos);
+void scull_seq_stop(struct seq_file *s, void *v);
+static void *scull_seq_next(struct seq_file *s, void *v, loff_t *pos);
+int scull_seq_show(struct seq_file *s, void *v);
+static void scull_cleanup_module(void);
+static void scull_exit(void);
+long scull_take_snapshot(struct scull_dev *dev);
+int scull_open(struct inode *inode, struct file *filp);
+ssize_t scull_read_iter(struct kiocb *iocb, struct iov_iter *to);
+int scull_release(struct inode *inode, struct file *filp);
+loff_t scull_llseek(struct file *filp, loff_t off, int whence);
+static void scull_setup_cdev(struct scull_dev *dev, int index);
+ssize_t scull_write_iter(struct kiocb *iocb, struct iov_iter *from);
+
+//struct scull_dev dev;
+struct scull_dev *scull_devs;
+
+int scull_major = SCULL_MAJOR;
+int scull_minor = SCULL_MINOR;
+int scull_nr_devs = SCULL_NR_DEVS;
+int scull_nr_snaps = SCULL_NR_SNAPS;
+int scull_numa_policy = SCULL_NUMA_LOCAL;
+int scull_numa_node = 0;
+
+// quantum can be raised to multi-MB chunks at load time, see scull_alloc_quantum
+module_param(scull_quantum, int, S_IRUGO);
+module_param(scull_qset, int, S_IRUGO);
+module_param(scull_max_size, ullong, S_IRUGO);
+module_param(scull_nr_snaps, int, S_IRUGO);
+// defaults for every device, SCULL_IOCSNUMA changes a single one
+module_param(scull_numa_policy, int, S_IRUGO);
+module_param(scull_numa_node, int, S_IRUGO);
+
+// serializes handing out of the snapshot minors
+static DEFINE_SEMAPHORE(scull_snap_sem);
+
+struct file_operations scull_fops = {
+    .owner = THIS_MODULE,
+    .llseek = scull_llseek,
+    .read_iter = scull_read_iter,
+    .unlocked_ioctl = scull_unlocked_ioctl,
+    .write_iter = scull_write_iter,
+    .open = scull_open,
+    .release = scull_release,
+};
+
+struct file_operations scull_proc_ops = {
+    .owner = THIS_MODULE,
+    .open = scull_proc_open,
+    .read = seq_read,
+    .llseek = seq_lseek,
+    .release = seq_release
+};
+
+struct seq_operations scull_seq_ops = {
+    .start = scull_seq_start,
+    .next = scull_seq_next,
+    .stop = scull_seq_stop,
+    .show = scull_seq_show
+};
+
+long scull_unlocked_ioctl(struct file *flip, unsigned int cmd, unsigned long arg)
+{
+    struct scull_dev *dev = flip->private_data;
+    struct scull_geometry geo;
+    struct scull_numa numa;
+    int tmp;
+    long retval = 0;
+    printk(KERN_INFO "in ioctl func\n");
+
+    switch(cmd) {
+
+        case SCULL_IOCRESET:
+          scull_quantum = SCULL_QUANTUM;
+          scull_qset = SCULL_QSET;
+          break;
+
+        case SCULL_IOCSQUANTUM:
+          if (!capable (CAP_SYS_ADMIN))
+              return -EPERM;
+          retval = __get_user(tmp, (int __user *)arg);
+          if (retval == 0 && tmp <= 0)
+              return -EINVAL;
+          if (retval == 0)
+              scull_quantum = tmp;
+          break;
+
+        case SCULL_IOCTQUANTUM:
+          if (!capable (CAP_SYS_ADMIN))
+              return -EPERM;
+          if ((int) arg <= 0)
+              return -EINVAL;
+          scull_quantum = arg;
+          break;
+
+        case SCULL_IOCGQUANTUM:
+          retval = __put_user(scull_quantum, (int __user *)arg);
+          break;
+
+        case SCULL_IOCQQUANTUM:
+          return scull_quantum;
+
+        case SCULL_IOCXQUANTUM:
+          if (!capable(CAP_SYS_ADMIN))
+              return -EPERM;
+          retval = __get_user(tmp, (int __user *)arg);
+          if (retval == 0 && tmp <= 0)
+              return -EINVAL;
+          if (retval == 0) {
+              retval = __put_user(scull_quantum, (int __user *)arg);
+              scull_quantum = tmp;
+          }
+          break;
+
+        case SCULL_IOCHQUANTUM:
+          if (!capable(CAP_SYS_ADMIN))
+              return -EPERM;
+          if ((int) arg <= 0)
+              return -EINVAL;
+          tmp = scull_quantum;
+          scull_quantum = arg;
+          return tmp;
+
+        case SCULL_IOCQSNAPSHOT:
+          if (!capable(CAP_SYS_ADMIN))
+              return -EPERM;
+          return scull_take_snapshot(dev);
+
+        case SCULL_IOCDROPSNAP:
+          if (!capable(CAP_SYS_ADMIN))
+              return -EPERM;
+          if (!dev->readonly)
+              return -EINVAL;
+          if (down_interruptible(&scull_snap_sem))
+              return -ERESTARTSYS;
+          down(&dev->sem);
+          scull_trim(dev);
+          dev->in_use = 0;
+          up(&dev->sem);
+          up(&scull_snap_sem);
+          break;
+
+        case SCULL_IOCGGEOMETRY:
+          if (down_interruptible(&dev->sem))
+              return -ERESTARTSYS;
+          geo.quantum = dev->quantum;
+          geo.qset = dev->qset;
+          geo.size = dev->size;
+          up(&dev->sem);
+          if (copy_to_user((void __user *)arg, &geo, sizeof(geo)))
+              return -EFAULT;
+          break;
+
+        case SCULL_IOCSGEOMETRY:
+          if (!(flip->f_mode & FMODE_WRITE))
+              return -EBADF;
+          if (copy_from_user(&geo, (void __user *)arg, sizeof(geo)))
+              return -EFAULT;
+          if (geo.quantum <= 0 || geo.qset <= 0 || geo.size < 0)
+              return -EINVAL;
+          // tiny quanta cost a list item and a qset array per few bytes
+          if ((geo.quantum != scull_quantum || geo.qset != scull_qset) &&
+              !capable(CAP_SYS_ADMIN))
+              return -EPERM;
+          // checked before the trim too, so a bad size leaves dev alone
+          if ((unsigned long long)geo.size > scull_max_size)
+              return -EFBIG;
+          if (down_interruptible(&dev->sem))
+              return -ERESTARTSYS;
+          scull_trim(dev);
+          dev->quantum = geo.quantum;
+          dev->qset = geo.qset;
+          retval = scull_presize(dev, geo.size);
+          if (retval)
+              scull_trim(dev);
+          up(&dev->sem);
+          break;
+
+        case SCULL_IOCGNUMA:
+          numa.policy = dev->numa_policy;
+          numa.node = dev->numa_node;
+          if (copy_to_user((void __user *)arg, &numa, sizeof(numa)))
+              return -EFAULT;
+          break;
+
+        case SCULL_IOCSNUMA:
+          if (!capable(CAP_SYS_ADMIN))
+              return -EPERM;
+          if (copy_from_user(&numa, (void __user *)arg, sizeof(numa)))
+              return -EFAULT;
+          if (!scull_numa_valid(numa.policy, numa.node))
+              return -EINVAL;
+          if (down_interruptible(&dev->sem))
+              return -ERESTARTSYS;
+          dev->numa_policy = numa.policy;
+          dev->numa_node = numa.node;
+          up(&dev->sem);
+          break;
+
+        default:
+          return -ENOTTY;
+    }
+    return retval;
+}
+
+static int scull_proc_open(struct inode *inode, struct file *file)
+{
+    return seq_open(file, &scull_seq_ops);
+}
+
+static void *scull_seq_start(struct seq_file *s, loff_t *pos)
+{
+    if (*pos >= scull_nr_devs + scull_nr_snaps) {
+        return NULL;
+    }
+    return scull_devs + *pos;
+}
+
+void scull_seq_stop(struct seq_file *s, void *v)
+{
+    printk(KERN_INFO "scull_seq_stop called\n");
+    
+}
+
+static void *scull_seq_next(struct seq_file *s, void *v, loff_t *pos)
+{
+    (*pos)++;
+    if (*pos >= scull_nr_devs + scull_nr_snaps)
+        return NULL;
+    return scull_devs + *pos;
+}
+
+int scull_seq_show(struct seq_file *s, void *v)
+{
+    struct scull_dev *dev = (struct scull_dev *) v;
+    struct scull_qset *d;
+    int i;
+    
+    if (down_interruptible(&dev->sem))
+        return -ERESTARTSYS;
+    seq_printf(s, "\nDevice %i: qset %i, q %i, sz %lli\n",
+               (int) (dev - scull_devs), dev->qset, dev->quantum,
+               (long long) dev->size);
+    seq_printf(s, " numa policy %i node %i, quanta held:",
+               dev->numa_policy, dev->numa_node);
+    for_each_online_node(i)
+        seq_printf(s, " node%i %li", i,
+                   dev->node_quanta ? atomic_long_read(&dev->node_quanta[i]) : 0);
+    seq_printf(s, "\n");
+    for (d = dev->data; d; d = d->next) { // scan the list
+        seq_printf(s, " item at %p, qset at %p\n", d, d->data);
+        if (d->data && !d->next)
+            for (i = 0; i < dev->qset; i++) {
+                if (d->data->quanta[i])
+                    seq_printf(s, "    % 4i: %8p\n", i, d->data->quanta[i]);
+            }
+    }
+    up(&dev->sem);
+    return 0;
+}
+
+static int scull_init(void)
+{
+    int i, result, nr_minors = scull_nr_devs + scull_nr_snaps;
+
+    // scull_locate divides by both, reject them like the quantum ioctls do
+    if (scull_quantum <= 0 || scull_qset <= 0 || !scull_max_size) {
+        printk(KERN_WARNING "scull: bad quantum %d qset %d max size %llu\n",
+               scull_quantum, scull_qset, scull_max_size);
+        return -EINVAL;
+    }
+    if (!scull_numa_valid(scull_numa_policy, scull_numa_node)) {
+        printk(KERN_WARNING "scull: bad numa policy %d node %d\n",
+               scull_numa_policy, scull_numa_node);
+        return -EINVAL;
+    }
+
+    // snapshot minors follow the regular ones
+    result = alloc_chrdev_region(&dev_no, scull_minor, nr_minors, "scull");
+    if (result < 0) {
+        printk(KERN_WARNING "scull: can't get major %d\n",scull_major);
+        return result;
+    }
+    scull_major = MAJOR(dev_no);
+
+    scull_devs = kmalloc(nr_minors * sizeof(struct scull_dev), GFP_KERNEL);
+    if (!scull_devs) {
+        result = -ENOMEM;
+        goto fail;
+    }
+
+    memset(scull_devs, 0, nr_minors * sizeof(struct scull_dev));
+
+    for (i = 0; i < nr_minors; i++) {
+        scull_devs[i].node_quanta = kcalloc(nr_node_ids, sizeof(atomic_long_t), GFP_KERNEL);
+        if (!scull_devs[i].node_quanta) {
+            result = -ENOMEM;
+            goto fail;
+        }
+        scull_devs[i].numa_policy = scull_numa_policy;
+        scull_devs[i].numa_node = scull_numa_node;
+        scull_devs[i].numa_next = first_online_node;
+        scull_devs[i].quantum = scull_quantum;
+        scull_devs[i].data = NULL;
+        scull_devs[i].qset = scull_qset;
+        scull_devs[i].readonly = i >= scull_nr_devs;
+        sema_init(&scull_devs[i].sem, 1);
+    }
+    // cdevs go live last, the fail path above never has any to delete
+    for (i = 0; i < nr_minors; i++)
+        scull_setup_cdev(&scull_devs[i], i);
+    proc_create("scullseq", 0, NULL, &scull_proc_ops);
+    printk(KERN_INFO "init_module() called\n");
+    return 0;
+
+    fail:
+      scull_cleanup_module();
+      return result;
+}
+
+/*
+ * Grab a free snapshot minor and fill it from dev. Returns the minor number
+ * of the snapshot. Snapshots aren't taken of snapshot minors: a free one
+ * could be picked as its own target and deadlock on its semaphore.
+ */
+long scull_take_snapshot(struct scull_dev *dev)
+{
+    struct scull_dev *snap = NULL;
+    long retval;
+    int i;
+
+    if (dev->readonly)
+        return -EINVAL;
+    if (down_interruptible(&scull_snap_sem))
+        return -ERESTARTSYS;
+    for (i = scull_nr_devs; i < scull_nr_devs + scull_nr_snaps; i++) {
+        if (!scull_devs[i].in_use) {
+            snap = &scull_devs[i];
+            break;
+        }
+    }
+    if (!snap) {
+        retval = -EBUSY;
+        goto out;
+    }
+    if (down_interruptible(&dev->sem)) {
+        retval = -ERESTARTSYS;
+        goto out;
+    }
+    down(&snap->sem);
+    retval = scull_snapshot(snap, dev);
+    if (retval == 0) {
+        snap->in_use = 1;
+        retval = scull_minor + i;
+    }
+    up(&snap->sem);
+    up(&dev->sem);
+
+    out:
+      up(&scull_snap_sem);
+      return retval;
+}
+
+static void scull_cleanup_module(void)
+{
+    int i;
+    printk(KERN_INFO "cleanup_module() called\n");
+    // only unload gets here with cdevs added
+    for (i = 0; scull_devs && i < scull_nr_devs + scull_nr_snaps; i++)
+        if (scull_devs[i].cdev.ops)
+            cdev_del(&scull_devs[i].cdev);
+    unregister_chrdev_region(dev_no, scull_nr_devs + scull_nr_snaps);
+    if (!scull_devs)
+        return;
+    for (i = 0; i < scull_nr_devs + scull_nr_snaps; i++)
+        scull_trim(&scull_devs[i]);
+    // only now, the last trims may have counted down another device's quanta
+    for (i = 0; i < scull_nr_devs + scull_nr_snaps; i++)
+        kfree(scull_devs[i].node_quanta);
+    kfree(scull_devs);
+    scull_devs = NULL;
+}
+
+static void scull_exit(void)
+{
+    scull_cleanup_module();
+    printk(KERN_INFO "exit_module() called\n");
+}
+
+int scull_open(struct inode *inode, struct file *filp)
+{
+    struct scull_dev *dev; // device information
+
+    dev = container_of(inode->i_cdev, struct scull_dev, cdev);
+    filp->private_data = dev; // for other methods
+
+    // snapshots are read-only
+    if ( dev->readonly && (filp->f_flags & O_ACCMODE) != O_RDONLY )
+        return -EACCES;
+
+    // read_iter/write_iter never sleep when asked not to
+    filp->f_mode |= FMODE_NOWAIT;
+
+    if (  (filp->f_flags & O_ACCMODE) == O_WRONLY ) {
+        if ( down_interruptible(&dev->sem) )
+            return -ERESTARTSYS;
+        scull_trim(dev); // ignore errors
+        up(&dev->sem);
+    }
+    return 0; //success
+}
+
+/*
+ * With IOCB_NOWAIT (io_uring, RWF_NOWAIT) we only trylock the semaphore and
+ * allocate with GFP_NOWAIT, returning -EAGAIN instead of sleeping.
+ */
+static int scull_lock_iocb(struct scull_dev *dev, struct kiocb *iocb)
+{
+    if (iocb->ki_flags & IOCB_NOWAIT)
+        return down_trylock(&dev->sem) ? -EAGAIN : 0;
+    if ( down_interruptible(&dev->sem) )
+        return -ERESTARTSYS;
+    return 0;
+}
+
+static size_t scull_copy_to_iter(void *data, size_t len, void *to)
+{
+    return copy_to_iter(data, len, to);
+}
+
+static size_t scull_copy_from_iter(void *data, size_t len, void *from)
+{
+    return copy_from_iter(data, len, from);
+}
+
+ssize_t scull_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    struct scull_dev *dev = iocb->ki_filp->private_data;
+    ssize_t retval;
+
+    retval = scull_lock_iocb(dev, iocb);
+    if ( retval )
+        return retval;
+    retval = scull_read_at(dev, &iocb->ki_pos, iov_iter_count(to),
+                           scull_copy_to_iter, to);
+    up(&dev->sem);
+    return retval;
+}
+
+int scull_release(struct inode *inode, struct file *filp)
+{
+    return 0;
+}
+
+loff_t scull_llseek(struct file *filp, loff_t off, int whence)
+{
+    struct scull_dev *dev = filp->private_data;
+    loff_t newpos;
+
+    switch(whence) {
+      case 0: /* SEEK_SET */
+        newpos = off;
+        break;
+
+      case 1: /* SEEK_CUR */
+        newpos = filp->f_pos + off;
+        break;
+
+      case 2: /* SEEK_END */
+        newpos = dev->size + off;
+        break;
+
+      default: /* can't happen */
+        return -EINVAL;
+    }
+    if (newpos<0) return -EINVAL;
+    filp->f_pos = newpos;
+    return newpos;
+}
+
+ssize_t scull_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    struct scull_dev *dev = iocb->ki_filp->private_data;
+    int nowait = iocb->ki_flags & IOCB_NOWAIT;
+    ssize_t retval;
+
+    retval = scull_lock_iocb(dev, iocb);
+    if ( retval )
+        return retval;
+    // failing is expected without reclaim, -EAGAIN says it all
+    retval = scull_write_at(dev, &iocb->ki_pos, iov_iter_count(from), scull_copy_from_iter,
+                            from, nowait ? GFP_NOWAIT | __GFP_NOWARN : GFP_KERNEL);
+    up(&dev->sem);
+    if ( retval == -ENOMEM && nowait )
+        retval = -EAGAIN;
+    return retval;
+}
+
+static void scull_setup_cdev(struct scull_dev *dev, int index)
+{
+    int err, devno = MKDEV(scull_major, scull_minor + index);
+
+    // scull's file operation structure
+    cdev_init(&dev->cdev, &scull_fops);
+    dev->cdev.owner = THIS_MODULE;
+    dev->cdev.ops = &scull_fops;
+    err = cdev_add(&dev->cdev, devno, 1);
+    if ( err )
+    printk(KERN_NOTICE "Error %d adding scull%d", err, index);
+}
+
+module_init(scull_init);
+module_exit(scull_exit);
@@ -0,0 +1,315 @@
+/*
+ * Microbenchmarks for scull's storage core and pscull's ring, in the style
+ * of Google Benchmark: every benchmark runs for a growing number of
+ * iterations until it takes at least --benchmark_min_time seconds, then the
+ * time per iteration and the throughput are printed.
+ *
+ *   make bench
+ *   build/bench --benchmark_filter=Ring
+ */
+#include <stdio.h>
+#include <time.h>
+#include <linux/kernel.h>
+#include <linux/semaphore.h>
+#include "scull.h"
+#include "pscull.h"
+#include "copy.h"
+
+#define DEV_SIZE (64 << 20)
+
+struct bench_state {
+	long arg;
+	u64 iterations;
+	u64 bytes;		// processed over all iterations, for bytes_per_second
+	struct scull_dev dev;
+	struct pscull_dev ring;
+	loff_t *offsets;	// random offsets, precomputed out of the timed loop
+	uint8_t *buf;
+};
+
+struct benchmark {
+	const char *name;
+	void (*setup)(struct bench_state *st);
+	void (*run)(struct bench_state *st);
+	void (*teardown)(struct bench_state *st);
+	long args[6];		// zero terminated
+};
+
+#define NR_OFFSETS 4096
+
+static u64 rand_state = 88172645463325252ULL;
+
+static u64 xorshift64(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return rand_state;
+}
+
+static void dev_init(struct scull_dev *dev, int quantum, int qset)
+{
+	memset(dev, 0, sizeof(*dev));
+	dev->quantum = quantum;
+	dev->qset = qset;
+	sema_init(&dev->sem, 1);
+}
+
+// whole device written, so reads never hit holes
+static void dev_fill(struct bench_state *st, loff_t size)
+{
+	uint8_t *cur;
+	loff_t pos = 0;
+
+	while (pos < size) {
+		cur = st->buf;
+		if (scull_write_at(&st->dev, &pos, min_t(loff_t, size - pos, 1 << 20),
+				   copy_in, &cur, GFP_KERNEL) <= 0)
+			abort();
+	}
+}
+
+static void random_offsets(struct bench_state *st, loff_t size, long align)
+{
+	int i;
+
+	st->offsets = malloc(NR_OFFSETS * sizeof(loff_t));
+	for (i = 0; i < NR_OFFSETS; i++)
+		st->offsets[i] = (xorshift64() % (size / align)) * align;
+}
+
+static void io_setup(struct bench_state *st)
+{
+	dev_init(&st->dev, SCULL_QUANTUM, SCULL_QSET);
+	st->buf = calloc(1, 1 << 20);
+	dev_fill(st, DEV_SIZE);
+	random_offsets(st, DEV_SIZE - st->arg, st->arg);
+}
+
+static void io_teardown(struct bench_state *st)
+{
+	scull_trim(&st->dev);
+	free(st->offsets);
+	free(st->buf);
+}
+
+static void bm_locate(struct bench_state *st)
+{
+	u64 i, item, sink = 0;
+	int s_pos, q_pos;
+
+	for (i = 0; i < st->iterations; i++) {
+		scull_locate(&st->dev, st->offsets[i % NR_OFFSETS], &item, &s_pos, &q_pos);
+		sink += item + s_pos + q_pos;
+	}
+	__asm__ volatile("" : : "r"(sink));
+}
+
+static void locate_setup(struct bench_state *st)
+{
+	dev_init(&st->dev, SCULL_QUANTUM, SCULL_QSET);
+	st->offsets = malloc(NR_OFFSETS * sizeof(loff_t));
+	for (int i = 0; i < NR_OFFSETS; i++)
+		st->offsets[i] = xorshift64() >> 1;
+}
+
+// scull_follow down a list of arg qsets
+static void follow_setup(struct bench_state *st)
+{
+	int i;
+
+	dev_init(&st->dev, SCULL_QUANTUM, SCULL_QSET);
+	if (!scull_follow(&st->dev, st->arg - 1, GFP_KERNEL))
+		abort();
+	st->offsets = malloc(NR_OFFSETS * sizeof(loff_t));
+	for (i = 0; i < NR_OFFSETS; i++)
+		st->offsets[i] = xorshift64() % st->arg;
+}
+
+static void bm_follow(struct bench_state *st)
+{
+	u64 i;
+
+	for (i = 0; i < st->iterations; i++)
+		if (!scull_follow(&st->dev, st->offsets[i % NR_OFFSETS], GFP_KERNEL))
+			abort();
+}
+
+static void bm_seq_read(struct bench_state *st)
+{
+	uint8_t *cur;
+	loff_t pos = 0;
+	u64 i;
+
+	for (i = 0; i < st->iterations; i++) {
+		if (pos + st->arg > DEV_SIZE)
+			pos = 0;
+		cur = st->buf;
+		st->bytes += scull_read_at(&st->dev, &pos, st->arg, copy_out, &cur);
+	}
+}
+
+static void bm_seq_write(struct bench_state *st)
+{
+	uint8_t *cur;
+	loff_t pos = 0;
+	u64 i;
+
+	for (i = 0; i < st->iterations; i++) {
+		if (pos + st->arg > DEV_SIZE)
+			pos = 0;
+		cur = st->buf;
+		st->bytes += scull_write_at(&st->dev, &pos, st->arg, copy_in, &cur, GFP_KERNEL);
+	}
+}
+
+static void bm_rand_read(struct bench_state *st)
+{
+	uint8_t *cur;
+	loff_t pos;
+	u64 i;
+
+	for (i = 0; i < st->iterations; i++) {
+		pos = st->offsets[i % NR_OFFSETS];
+		cur = st->buf;
+		st->bytes += scull_read_at(&st->dev, &pos, st->arg, copy_out, &cur);
+	}
+}
+
+static void bm_rand_write(struct bench_state *st)
+{
+	uint8_t *cur;
+	loff_t pos;
+	u64 i;
+
+	for (i = 0; i < st->iterations; i++) {
+		pos = st->offsets[i % NR_OFFSETS];
+		cur = st->buf;
+		st->bytes += scull_write_at(&st->dev, &pos, st->arg, copy_in, &cur, GFP_KERNEL);
+	}
+}
+
+static void ring_setup(struct bench_state *st)
+{
+	st->buf = calloc(1, PSCULL_BUFFER_SIZE + st->arg);
+	pscull_ring_init(&st->ring, malloc(PSCULL_BUFFER_SIZE), PSCULL_BUFFER_SIZE);
+}
+
+static void ring_teardown(struct bench_state *st)
+{
+	free(st->ring.buffer);
+	free(st->buf);
+}
+
+// writer and reader taking turns, arg bytes at a time, as pscull_*_iter do
+static void bm_ring(struct bench_state *st)
+{
+	struct pscull_dev *ring = &st->ring;
+	size_t left, n;
+	u64 i;
+
+	for (i = 0; i < st->iterations; i++) {
+		for (left = st->arg; left; left -= n) {
+			n = pscull_write_chunk(ring, left);
+			memcpy(ring->wp, st->buf, n);
+			pscull_write_done(ring, n);
+		}
+		for (left = st->arg; left; left -= n) {
+			n = pscull_read_chunk(ring, left);
+			memcpy(st->buf, ring->rp, n);
+			pscull_read_done(ring, n);
+		}
+		st->bytes += st->arg;
+	}
+}
+
+static void no_teardown(struct bench_state *st)
+{
+	free(st->offsets);
+	scull_trim(&st->dev);
+}
+
+static const struct benchmark benchmarks[] = {
+	{ "BM_Locate", locate_setup, bm_locate, no_teardown, { 0 } },
+	{ "BM_Follow", follow_setup, bm_follow, no_teardown, { 8, 64, 512, 0 } },
+	{ "BM_SeqRead", io_setup, bm_seq_read, io_teardown, { 512, 4096, 65536, 1 << 20, 0 } },
+	{ "BM_SeqWrite", io_setup, bm_seq_write, io_teardown, { 512, 4096, 65536, 1 << 20, 0 } },
+	{ "BM_RandRead", io_setup, bm_rand_read, io_teardown, { 512, 4096, 65536, 0 } },
+	{ "BM_RandWrite", io_setup, bm_rand_write, io_teardown, { 512, 4096, 65536, 0 } },
+	{ "BM_Ring", ring_setup, bm_ring, ring_teardown, { 64, 1024, 4096, PSCULL_BUFFER_SIZE - 1, 0 } },
+};
+
+static double now(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void run_one(const struct benchmark *bm, long arg, double min_time)
+{
+	struct bench_state st;
+	double wall = 0, cpu = 0, t0, c0;
+	char name[64];
+
+	if (arg)
+		snprintf(name, sizeof(name), "%s/%ld", bm->name, arg);
+	else
+		snprintf(name, sizeof(name), "%s", bm->name);
+
+	// grow the iteration count until a run takes long enough
+	for (u64 iters = 1; ; iters *= 10) {
+		memset(&st, 0, sizeof(st));
+		st.arg = arg;
+		st.iterations = iters;
+		bm->setup(&st);
+		t0 = now(CLOCK_MONOTONIC);
+		c0 = now(CLOCK_PROCESS_CPUTIME_ID);
+		bm->run(&st);
+		cpu = now(CLOCK_PROCESS_CPUTIME_ID) - c0;
+		wall = now(CLOCK_MONOTONIC) - t0;
+		bm->teardown(&st);
+		if (wall >= min_time || iters >= 1000000000ULL)
+			break;
+	}
+
+	printf("%-28s %10.1f ns %10.1f ns %12llu", name,
+	       wall * 1e9 / st.iterations, cpu * 1e9 / st.iterations,
+	       (unsigned long long)st.iterations);
+	if (st.bytes)
+		printf(" bytes_per_second=%.4gGi/s", st.bytes / wall / (1 << 30));
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	const char *filter = NULL;
+	double min_time = 0.5;
+	size_t i;
+	int j;
+
+	for (j = 1; j < argc; j++) {
+		if (!strncmp(argv[j], "--benchmark_filter=", 19))
+			filter = argv[j] + 19;
+		else if (!strncmp(argv[j], "--benchmark_min_time=", 21))
+			min_time = atof(argv[j] + 21);
+		else {
+			fprintf(stderr, "usage: %s [--benchmark_filter=substring] [--benchmark_min_time=seconds]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	printf("%-28s %13s %13s %12s\n", "Benchmark", "Time", "CPU", "Iterations");
+	printf("--------------------------------------------------------------------------------\n");
+	for (i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		if (filter && !strstr(benchmarks[i].name, filter))
+			continue;
+		if (!benchmarks[i].args[0])
+			run_one(&benchmarks[i], 0, min_time);
+		for (j = 0; benchmarks[i].args[j]; j++)
+			run_one(&benchmarks[i], benchmarks[i].args[j], min_time);
+	}
+	return 0;
+}
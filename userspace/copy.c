@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include <string.h>
+#include "copy.h"
+
+size_t copy_in(void *data, size_t len, void *ctx)
+{
+	uint8_t **cur = ctx;
+
+	memcpy(data, *cur, len);
+	*cur += len;
+	return len;
+}
+
+size_t copy_out(void *data, size_t len, void *ctx)
+{
+	uint8_t **cur = ctx;
+
+	memcpy(*cur, data, len);
+	*cur += len;
+	return len;
+}
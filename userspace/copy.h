@@ -0,0 +1,14 @@
+/*
+ * scull_copy_t callbacks over a plain buffer, what copy_to_iter and
+ * copy_from_iter are in the driver. ctx points to a uint8_t * cursor that
+ * moves along like an iov_iter.
+ */
+#ifndef SCULL_COPY_H
+#define SCULL_COPY_H
+
+#include <stddef.h>
+
+size_t copy_in(void *data, size_t len, void *ctx);
+size_t copy_out(void *data, size_t len, void *ctx);
+
+#endif /* SCULL_COPY_H */
@@ -0,0 +1,288 @@
+/*
+ * libFuzzer target for the offset and wrap arithmetic: the input is a
+ * program of operations run both on the real code and on a flat model,
+ * any disagreement aborts. The first byte picks what is fuzzed:
+ *
+ *   even  a small scull device: writes (some past scull_max_size), reads,
+ *         discards, trims, one snapshot, scull_locate on arbitrary 64-bit
+ *         offsets, and kmalloc failures injected into writes
+ *   odd   a pscull ring: chunked writes and reads of a byte stream
+ *
+ *   make fuzz && build/fuzz_core -max_len=4096 corpus/
+ *   make fuzz_standalone && build/fuzz_standalone	(no clang needed)
+ */
+#include <stdio.h>
+#include <linux/kernel.h>
+#include <linux/semaphore.h>
+#include "scull.h"
+#include "pscull.h"
+#include "copy.h"
+
+#define check(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: check failed: %s\n",		\
+			__FILE__, __LINE__, #cond);			\
+		abort();						\
+	}								\
+} while (0)
+
+// input reader, reads past the end give zeroes
+struct input {
+	const uint8_t *data;
+	size_t size;
+};
+
+static uint64_t take(struct input *in, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes--) {
+		v <<= 8;
+		if (in->size) {
+			v |= *in->data++;
+			in->size--;
+		}
+	}
+	return v;
+}
+
+/*
+ * The scull model is flat: the bytes, whether each one holds a known value
+ * (a fresh quantum isn't zeroed, so bytes around a write into a hole are
+ * not), and which quanta exist, since reads stop at holes.
+ */
+#define MODEL_SIZE 4096
+#define MAX_SIZE 3000	// scull_max_size, in reach of the writes below
+
+struct model {
+	loff_t size;
+	int quantum;
+	uint8_t data[MODEL_SIZE];
+	uint8_t known[MODEL_SIZE];
+	uint8_t present[MODEL_SIZE];	// per quantum
+};
+
+static int fail_countdown = -1;
+
+// fail the fail_countdown'th allocation from now, then keep succeeding
+static int alloc_fail(size_t size)
+{
+	(void)size;
+	return fail_countdown >= 0 && fail_countdown-- == 0;
+}
+
+static void model_write(struct model *m, loff_t pos, const uint8_t *buf, size_t len)
+{
+	size_t i;
+	int qi;
+
+	for (i = 0; i < len; i++) {
+		qi = (pos + i) / m->quantum;
+		if (!m->present[qi]) {
+			m->present[qi] = 1;
+			memset(m->known + (size_t)qi * m->quantum, 0, m->quantum);
+		}
+		m->data[pos + i] = buf[i];
+		m->known[pos + i] = 1;
+	}
+	if (m->size < pos + (loff_t)len)
+		m->size = pos + len;
+}
+
+static void model_discard(struct model *m, loff_t pos, loff_t len)
+{
+	loff_t end = pos + len, qstart;
+	int qi;
+
+	for (; pos < end; pos = qstart + m->quantum) {
+		qi = pos / m->quantum;
+		qstart = (loff_t)qi * m->quantum;
+		if (!m->present[qi])
+			continue;
+		if (pos == qstart && end >= qstart + m->quantum) {
+			m->present[qi] = 0;
+			continue;
+		}
+		for (; pos < end && pos < qstart + m->quantum; pos++) {
+			m->data[pos] = 0;
+			m->known[pos] = 1;
+		}
+	}
+}
+
+// read everything from pos on and compare with the model
+static void check_read(struct scull_dev *dev, struct model *m, loff_t pos, size_t len)
+{
+	static uint8_t buf[MODEL_SIZE];
+	loff_t end = pos, start = pos;
+	uint8_t *cur = buf;
+	ssize_t n;
+	size_t i;
+
+	// a read stops at EOF and at the first hole
+	while (end < m->size && end < pos + (loff_t)len && m->present[end / m->quantum])
+		end++;
+	// reads never allocate: the first kmalloc would fail and be seen here
+	fail_countdown = 0;
+	n = scull_read_at(dev, &pos, len, copy_out, &cur);
+	check(fail_countdown == 0);
+	fail_countdown = -1;
+	check(n == end - start);
+	check(pos == end);
+	for (i = 0; i < (size_t)n; i++)
+		if (m->known[start + i])
+			check(buf[i] == m->data[start + i]);
+}
+
+static void check_locate(struct input *in)
+{
+	struct scull_dev dev = { 0 };
+	u64 pos, item;
+	int s_pos, q_pos;
+
+	// any geometry scull accepts, up to huge quanta and offsets past 2^62
+	dev.quantum = take(in, 4) % INT32_MAX + 1;
+	dev.qset = take(in, 4) % INT32_MAX + 1;
+	pos = take(in, 8) >> 1;
+	scull_locate(&dev, pos, &item, &s_pos, &q_pos);
+	check(s_pos >= 0 && s_pos < dev.qset);
+	check(q_pos >= 0 && q_pos < dev.quantum);
+	check(item * dev.quantum * dev.qset + (u64)s_pos * dev.quantum + q_pos == pos);
+}
+
+static void fuzz_scull(struct input *in)
+{
+	static struct model m, snap_m;
+	struct scull_dev dev = { 0 }, snap = { 0 };
+	atomic_long_t node_quanta = { 0 };
+	static uint8_t buf[MODEL_SIZE];
+	uint8_t *cur;
+	loff_t pos, len, start;
+	ssize_t n;
+	int has_snap = 0, op;
+	size_t i;
+
+	scull_max_size = MAX_SIZE;
+	memset(&m, 0, sizeof(m));
+	dev.quantum = take(in, 1) % 64 + 1;
+	dev.qset = take(in, 1) % 8 + 1;
+	sema_init(&dev.sem, 1);
+	dev.node_quanta = &node_quanta;
+	m.quantum = dev.quantum;
+
+	while (in->size) {
+		op = take(in, 1) % 6;
+		pos = take(in, 2) % (MODEL_SIZE / 2);
+		len = take(in, 2) % (MODEL_SIZE / 2);
+		switch (op) {
+		case 0: // write, maybe with an allocation failing half way
+			fail_countdown = take(in, 1) % 16 - 1;
+			for (i = 0; i < (size_t)len; i++)
+				buf[i] = take(in, 1);
+			cur = buf;
+			start = pos;
+			n = scull_write_at(&dev, &pos, len, copy_in, &cur, GFP_KERNEL);
+			fail_countdown = -1;
+			if (len && start >= MAX_SIZE)
+				check(n == -EFBIG);
+			else
+				check(n == -ENOMEM || (n >= 0 && n <= min(len, MAX_SIZE - start)));
+			if (n > 0)
+				model_write(&m, start, buf, n);
+			check(dev.size == m.size);
+			break;
+		case 1:
+			check_read(&dev, &m, pos, len);
+			break;
+		case 2:
+			check(scull_discard(&dev, pos, len) == 0);
+			model_discard(&m, pos, len);
+			break;
+		case 3: // the snapshot keeps its contents whatever dev goes through
+			if (has_snap) {
+				check_read(&snap, &snap_m, 0, MODEL_SIZE);
+				scull_trim(&snap);
+			}
+			snap.quantum = snap.qset = 0;
+			check(scull_snapshot(&snap, &dev) == 0);
+			snap_m = m;
+			has_snap = 1;
+			break;
+		case 4:
+			check_locate(in);
+			break;
+		case 5:
+			if (take(in, 1) % 8)
+				break;
+			scull_trim(&dev);
+			dev.quantum = m.quantum;
+			dev.qset = take(in, 1) % 8 + 1;
+			memset(&m, 0, sizeof(m));
+			m.quantum = dev.quantum;
+			break;
+		}
+	}
+	check_read(&dev, &m, 0, MODEL_SIZE);
+	if (has_snap) {
+		check_read(&snap, &snap_m, 0, MODEL_SIZE);
+		scull_trim(&snap);
+	}
+	scull_trim(&dev);
+	// every quantum counted was freed again, whoever dropped it last
+	check(atomic_long_read(&node_quanta) == 0);
+}
+
+/*
+ * The ring carries a counting byte stream; the model is just how many bytes
+ * went in and out.
+ */
+static void fuzz_ring(struct input *in)
+{
+	struct pscull_dev ring;
+	size_t size, want, n, stored;
+	uint64_t written = 0, read = 0;
+	char *buffer;
+
+	size = take(in, 1) % 63 + 2;
+	buffer = malloc(size);
+	pscull_ring_init(&ring, buffer, size);
+
+	while (in->size) {
+		want = take(in, 1);
+		stored = written - read;
+		check(pscull_spacefree(&ring) == (int)(size - 1 - stored));
+		check(ring.rp >= ring.buffer && ring.rp < ring.end);
+		check(ring.wp >= ring.buffer && ring.wp < ring.end);
+		if (want & 1) {
+			n = pscull_write_chunk(&ring, want >> 1);
+			check(n <= want >> 1 && n <= size - 1 - stored);
+			// no progress only when full
+			check(n || !(want >> 1) || stored == size - 1);
+			for (size_t i = 0; i < n; i++)
+				ring.wp[i] = (char)(written + i);
+			pscull_write_done(&ring, n);
+			written += n;
+		} else {
+			n = pscull_read_chunk(&ring, want >> 1);
+			check(n <= want >> 1 && n <= stored);
+			check(n || !(want >> 1) || !stored);
+			for (size_t i = 0; i < n; i++)
+				check(ring.rp[i] == (char)(read + i));
+			pscull_read_done(&ring, n);
+			read += n;
+		}
+	}
+	free(buffer);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct input in = { data, size };
+
+	kshim_alloc_fail = alloc_fail;
+	if (take(&in, 1) & 1)
+		fuzz_ring(&in);
+	else
+		fuzz_scull(&in);
+	return 0;
+}
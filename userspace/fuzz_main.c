@@ -0,0 +1,83 @@
+/*
+ * Stand-in for libFuzzer when clang isn't around: runs the files given on
+ * the command line through LLVMFuzzerTestOneInput, or without arguments
+ * random inputs for a while. Finds far less than the real thing. An input
+ * that aborts is saved to crash-input, to be replayed under a debugger.
+ *
+ *   build/fuzz_standalone [-runs=N] [-seed=N] [FILE...]
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static uint8_t buf[1 << 16];
+static size_t buf_len;
+
+static void save_crash(int sig)
+{
+	int fd = open("crash-input", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	ssize_t n;
+
+	if (fd >= 0) {
+		n = write(fd, buf, buf_len);
+		(void)n; // about to die anyway
+		close(fd);
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+static int run_file(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	size_t n;
+
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	n = fread(buf, 1, sizeof(buf), f);
+	fclose(f);
+	LLVMFuzzerTestOneInput(buf, n);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long runs = 100000, i;
+	unsigned int seed = 1;
+	int files = 0, err = 0, j;
+	size_t len, k;
+
+	for (j = 1; j < argc; j++) {
+		if (!strncmp(argv[j], "-runs=", 6))
+			runs = strtoul(argv[j] + 6, NULL, 0);
+		else if (!strncmp(argv[j], "-seed=", 6))
+			seed = strtoul(argv[j] + 6, NULL, 0);
+		else {
+			err |= run_file(argv[j]);
+			files++;
+		}
+	}
+	if (files)
+		return err;
+
+	signal(SIGABRT, save_crash);
+	srand(seed);
+	for (i = 0; i < runs; i++) {
+		// mostly short programs, now and then a long one
+		len = rand() % (i % 16 ? 256 : 4096);
+		for (k = 0; k < len; k++)
+			buf[k] = rand();
+		buf_len = len;
+		LLVMFuzzerTestOneInput(buf, len);
+	}
+	printf("%lu runs, seed %u, no failures\n", runs, seed);
+	return 0;
+}
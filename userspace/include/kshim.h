@@ -0,0 +1,135 @@
+/*
+ * Just enough of the kernel API to build scull_core.c and pscull_ring.c in
+ * user space (see userspace/Makefile). Single node, single threaded
+ * semaphores, malloc for every allocator. Not meant as a general shim.
+ */
+#ifndef SCULL_KSHIM_H
+#define SCULL_KSHIM_H
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#define __user
+#define EXPORT_SYMBOL(sym)
+#define READ_ONCE(x) (*(volatile __typeof__(x) *)&(x))
+
+typedef uint64_t u64;
+typedef uint32_t u32;
+typedef unsigned int __poll_t;
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define min_t(type, a, b) min((type)(a), (type)(b))
+
+static inline u64 div64_u64_rem(u64 dividend, u64 divisor, u64 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+static inline u64 div_u64_rem(u64 dividend, u32 divisor, u32 *remainder)
+{
+	*remainder = dividend % divisor;
+	return dividend / divisor;
+}
+
+// atomics
+typedef struct { int counter; } atomic_t;
+
+static inline void atomic_set(atomic_t *v, int i) { __atomic_store_n(&v->counter, i, __ATOMIC_RELAXED); }
+static inline int atomic_read(const atomic_t *v) { return __atomic_load_n(&v->counter, __ATOMIC_RELAXED); }
+static inline void atomic_inc(atomic_t *v) { __atomic_add_fetch(&v->counter, 1, __ATOMIC_RELAXED); }
+static inline int atomic_dec_and_test(atomic_t *v) { return __atomic_sub_fetch(&v->counter, 1, __ATOMIC_ACQ_REL) == 0; }
+
+typedef struct { long counter; } atomic_long_t;
+
+static inline long atomic_long_read(const atomic_long_t *v) { return __atomic_load_n(&v->counter, __ATOMIC_RELAXED); }
+static inline void atomic_long_inc(atomic_long_t *v) { __atomic_add_fetch(&v->counter, 1, __ATOMIC_RELAXED); }
+static inline void atomic_long_dec(atomic_long_t *v) { __atomic_sub_fetch(&v->counter, 1, __ATOMIC_RELAXED); }
+
+// allocation; kshim_alloc_fail lets the fuzzer inject failures
+typedef unsigned int gfp_t;
+#define __GFP_RECLAIM 0x1u
+#define __GFP_IO 0x2u
+#define __GFP_FS 0x4u
+#define __GFP_NOWARN 0x8u
+#define GFP_NOWAIT 0u
+#define GFP_NOIO __GFP_RECLAIM
+#define GFP_KERNEL (__GFP_RECLAIM | __GFP_IO | __GFP_FS)
+#define PAGE_SIZE 4096UL
+#define KMALLOC_MAX_SIZE (PAGE_SIZE << 10)
+
+extern int (*kshim_alloc_fail)(size_t size);
+
+static inline void *kmalloc(size_t size, gfp_t gfp)
+{
+	(void)gfp;
+	if (kshim_alloc_fail && kshim_alloc_fail(size))
+		return NULL;
+	return malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t gfp)
+{
+	void *p = kmalloc(size, gfp);
+
+	if (p)
+		memset(p, 0, size);
+	return p;
+}
+
+#define kcalloc(n, size, gfp) kzalloc((n) * (size), gfp)
+#define kmalloc_node(size, gfp, node) ((void)(node), kmalloc(size, gfp))
+#define kvmalloc_node(size, gfp, node) ((void)(node), kmalloc(size, gfp))
+#define kvmalloc(size, gfp) kmalloc(size, gfp)
+#define kfree(p) free(p)
+#define kvfree(p) free(p)
+
+// one online node
+#define MAX_NUMNODES 1
+#define NUMA_NO_NODE (-1)
+#define nr_node_ids 1
+#define first_online_node 0
+#define node_online(node) ((node) == 0)
+#define next_online_node(node) MAX_NUMNODES
+#define num_online_nodes() 1
+#define numa_node_id() 0
+#define for_each_online_node(node) for ((node) = 0; (node) < 1; (node)++)
+
+struct page { int nid; };
+static struct page kshim_page __attribute__((unused));
+#define is_vmalloc_addr(p) 0
+#define virt_to_page(p) (&kshim_page)
+#define vmalloc_to_page(p) (&kshim_page)
+#define page_to_nid(page) ((void)(page), 0)
+
+// one task that is never signalled and never has to yield
+#define current NULL
+#define fatal_signal_pending(task) ((void)(task), 0)
+#define cond_resched() do { } while (0)
+
+// nobody else runs, a semaphore is a counter
+struct semaphore { int count; };
+
+static inline void sema_init(struct semaphore *sem, int val) { sem->count = val; }
+static inline void down(struct semaphore *sem) { sem->count--; }
+static inline int down_interruptible(struct semaphore *sem) { sem->count--; return 0; }
+static inline int down_trylock(struct semaphore *sem) { if (sem->count <= 0) return 1; sem->count--; return 0; }
+static inline void up(struct semaphore *sem) { sem->count++; }
+
+// types the headers only embed or point to
+struct cdev { int unused; };
+typedef struct { int unused; } wait_queue_head_t;
+struct fasync_struct;
+struct file;
+struct inode;
+struct kiocb;
+struct iov_iter;
+struct seq_file;
+struct poll_table_struct;
+typedef struct poll_table_struct poll_table;
+
+#endif /* SCULL_KSHIM_H */
@@ -0,0 +1,4 @@
+#include "kshim.h"
+
+// set by the fuzzer to make kmalloc fail on demand
+int (*kshim_alloc_fail)(size_t size);